@@ -0,0 +1,430 @@
+#pragma once
+
+#include "expanded_routes.h"
+#include "graph.h"
+#include "search_buffers.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Contraction hierarchies: vertices are contracted one by one in order of importance,
+  // and shortcut edges are added wherever a contraction would destroy a shortest path.
+  // Any shortest path then goes up the hierarchy and then down,
+  // so a query is a bidirectional Dijkstra which only follows edges to higher ranked vertices.
+  template <typename Weight>
+  class ContractionHierarchyRouter {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    ContractionHierarchyRouter(const Graph& graph);
+    // Hierarchy written by Serialize for the same graph, viewed in the mapping of the reader
+    ContractionHierarchyRouter(const Graph& graph, Snapshot::Reader& reader);
+
+    using RouteId = ExpandedRoutes::RouteId;
+
+    struct RouteInfo {
+      RouteId id;
+      Weight weight;
+      size_t edge_count;
+    };
+
+    // Replaces the contents of route_edges with the route edges and returns the route weight.
+    // Reuses the buffer capacity and keeps no state, so nothing has to be released.
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, std::vector<EdgeId>& route_edges) const;
+
+    // Same route kept inside the router until ReleaseRoute
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
+    void ReleaseRoute(RouteId route_id);
+
+    void Serialize(Snapshot::Writer& writer) const;
+
+  private:
+    using HierarchyEdgeId = size_t;
+
+    // Either an original graph edge or a shortcut replacing two hierarchy edges
+    // through a contracted vertex
+    struct HierarchyEdge {
+      VertexId from;
+      VertexId to;
+      Weight weight;
+      EdgeId original_edge;  // NO_EDGE for shortcuts
+      HierarchyEdgeId first_half;
+      HierarchyEdgeId second_half;
+    };
+
+    // Witness searches give up after settling this many vertices and add the shortcut anyway:
+    // an unnecessary shortcut costs memory, never correctness
+    static constexpr size_t WITNESS_SETTLED_LIMIT = 64;
+
+    const Graph& graph_;
+    Snapshot::Array<HierarchyEdge> edges_;
+    std::vector<size_t> ranks_;  // needed only to build the hierarchy, not serialized
+    // Forward search runs over upward_graph_ (edges to higher ranked vertices),
+    // backward search over downward_graph_ (reversed edges from higher ranked vertices).
+    // Both are frozen; their edge ids map to hierarchy edges through *_hierarchy_edges_.
+    Graph upward_graph_;
+    Snapshot::Array<HierarchyEdgeId> upward_hierarchy_edges_;
+    Graph downward_graph_;
+    Snapshot::Array<HierarchyEdgeId> downward_hierarchy_edges_;
+
+    mutable ExpandedRoutes expanded_routes_;
+
+    struct ContractionState {
+      std::vector<std::vector<HierarchyEdgeId>> out_edges;
+      std::vector<std::vector<HierarchyEdgeId>> in_edges;
+      std::vector<bool> contracted;
+      std::vector<int> contracted_neighbours;
+      SearchBuffers<Weight> witness_buffers;
+    };
+
+    void BuildHierarchy();
+    // Returns the number of shortcuts needed to contract the vertex; adds them if asked to
+    size_t ContractVertex(ContractionState& state, VertexId vertex, bool add_shortcuts);
+    int ComputePriority(ContractionState& state, VertexId vertex);
+    void RunWitnessSearch(ContractionState& state, VertexId source, VertexId ignored_vertex, Weight max_weight) const;
+    HierarchyEdgeId AddShortcut(ContractionState& state, HierarchyEdgeId first_half, HierarchyEdgeId second_half);
+
+    void RunUpwardSearches(SearchBuffers<Weight>& forward, SearchBuffers<Weight>& backward,
+                           VertexId from, VertexId to,
+                           std::optional<VertexId>& meeting_vertex) const;
+    // Appends original edges of the hierarchy edges on the stack, top first, emptying the stack
+    void UnpackEdges(std::vector<HierarchyEdgeId>& stack, std::vector<EdgeId>& edges) const;
+  };
+
+
+  template <typename Weight>
+  ContractionHierarchyRouter<Weight>::ContractionHierarchyRouter(const Graph& graph)
+      : graph_(graph),
+        ranks_(graph.GetVertexCount()),
+        upward_graph_(graph.GetVertexCount()),
+        downward_graph_(graph.GetVertexCount())
+  {
+    BuildHierarchy();
+  }
+
+  template <typename Weight>
+  ContractionHierarchyRouter<Weight>::ContractionHierarchyRouter(const Graph& graph, Snapshot::Reader& reader)
+      : graph_(graph),
+        edges_(reader.ReadMappedArray<HierarchyEdge>()),
+        upward_graph_(reader),
+        upward_hierarchy_edges_(reader.ReadMappedArray<HierarchyEdgeId>()),
+        downward_graph_(reader),
+        downward_hierarchy_edges_(reader.ReadMappedArray<HierarchyEdgeId>())
+  {
+    if (upward_graph_.GetVertexCount() != graph.GetVertexCount()
+        || downward_graph_.GetVertexCount() != graph.GetVertexCount()
+        || upward_hierarchy_edges_.size() != upward_graph_.GetEdgeCount()
+        || downward_hierarchy_edges_.size() != downward_graph_.GetEdgeCount()) {
+      throw Snapshot::FormatError("malformed contraction hierarchy");
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::Serialize(Snapshot::Writer& writer) const {
+    writer.WriteArray(edges_);
+    upward_graph_.Serialize(writer);
+    writer.WriteArray(upward_hierarchy_edges_);
+    downward_graph_.Serialize(writer);
+    writer.WriteArray(downward_hierarchy_edges_);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::BuildHierarchy() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    ContractionState state{
+        .out_edges = std::vector<std::vector<HierarchyEdgeId>>(vertex_count),
+        .in_edges = std::vector<std::vector<HierarchyEdgeId>>(vertex_count),
+        .contracted = std::vector<bool>(vertex_count, false),
+        .contracted_neighbours = std::vector<int>(vertex_count, 0),
+    };
+
+    edges_.Edit().reserve(graph_.GetEdgeCount());
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+      const auto& edge = graph_.GetEdge(edge_id);
+      assert(edge.weight >= 0);
+      if (edge.from == edge.to) {
+        continue;  // loops never belong to a shortest path
+      }
+      const HierarchyEdgeId hierarchy_edge_id = edges_.size();
+      edges_.Edit().push_back({edge.from, edge.to, edge.weight, edge_id, 0, 0});
+      state.out_edges[edge.from].push_back(hierarchy_edge_id);
+      state.in_edges[edge.to].push_back(hierarchy_edge_id);
+    }
+
+    using QueueItem = std::pair<int, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+      queue.emplace(ComputePriority(state, vertex), vertex);
+    }
+
+    // Priorities of not yet contracted vertices change as their neighbours are contracted,
+    // so a popped vertex is rechecked and postponed if it is no longer the best candidate
+    size_t next_rank = 0;
+    while (!queue.empty()) {
+      const VertexId vertex = queue.top().second;
+      queue.pop();
+      const int priority = ComputePriority(state, vertex);
+      if (!queue.empty() && priority > queue.top().first) {
+        queue.emplace(priority, vertex);
+        continue;
+      }
+
+      ContractVertex(state, vertex, true);
+      state.contracted[vertex] = true;
+      ranks_[vertex] = next_rank++;
+      for (const HierarchyEdgeId edge_id : state.out_edges[vertex]) {
+        ++state.contracted_neighbours[edges_[edge_id].to];
+      }
+      for (const HierarchyEdgeId edge_id : state.in_edges[vertex]) {
+        ++state.contracted_neighbours[edges_[edge_id].from];
+      }
+    }
+
+    for (HierarchyEdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+      const auto& edge = edges_[edge_id];
+      if (ranks_[edge.from] < ranks_[edge.to]) {
+        upward_graph_.AddEdge({edge.from, edge.to, edge.weight});
+        upward_hierarchy_edges_.Edit().push_back(edge_id);
+      } else {
+        downward_graph_.AddEdge({edge.to, edge.from, edge.weight});
+        downward_hierarchy_edges_.Edit().push_back(edge_id);
+      }
+    }
+    upward_graph_.Freeze();
+    downward_graph_.Freeze();
+  }
+
+  template <typename Weight>
+  int ContractionHierarchyRouter<Weight>::ComputePriority(ContractionState& state, VertexId vertex) {
+    // Edge difference: prefer vertices whose contraction removes more edges than it adds
+    int removed_edge_count = 0;
+    for (const HierarchyEdgeId edge_id : state.out_edges[vertex]) {
+      removed_edge_count += !state.contracted[edges_[edge_id].to];
+    }
+    for (const HierarchyEdgeId edge_id : state.in_edges[vertex]) {
+      removed_edge_count += !state.contracted[edges_[edge_id].from];
+    }
+    const int shortcut_count = static_cast<int>(ContractVertex(state, vertex, false));
+    return shortcut_count - removed_edge_count + state.contracted_neighbours[vertex];
+  }
+
+  template <typename Weight>
+  size_t ContractionHierarchyRouter<Weight>::ContractVertex(ContractionState& state, VertexId vertex,
+                                                            bool add_shortcuts) {
+    std::optional<Weight> max_out_weight;
+    for (const HierarchyEdgeId out_edge_id : state.out_edges[vertex]) {
+      const auto& out_edge = edges_[out_edge_id];
+      if (!state.contracted[out_edge.to] && (!max_out_weight || *max_out_weight < out_edge.weight)) {
+        max_out_weight = out_edge.weight;
+      }
+    }
+    if (!max_out_weight) {
+      return 0;
+    }
+
+    size_t shortcut_count = 0;
+    // Shortcuts are appended to state.in_edges/out_edges of neighbours only, never of vertex itself
+    for (size_t in_idx = 0; in_idx < state.in_edges[vertex].size(); ++in_idx) {
+      const HierarchyEdgeId in_edge_id = state.in_edges[vertex][in_idx];
+      const VertexId source = edges_[in_edge_id].from;
+      if (state.contracted[source]) {
+        continue;
+      }
+      const Weight in_weight = edges_[in_edge_id].weight;
+      RunWitnessSearch(state, source, vertex, in_weight + *max_out_weight);
+
+      for (size_t out_idx = 0; out_idx < state.out_edges[vertex].size(); ++out_idx) {
+        const HierarchyEdgeId out_edge_id = state.out_edges[vertex][out_idx];
+        const VertexId target = edges_[out_edge_id].to;
+        if (state.contracted[target] || target == source) {
+          continue;
+        }
+        const Weight path_weight = in_weight + edges_[out_edge_id].weight;
+        const auto& witness = state.witness_buffers;
+        if (witness.IsReached(target) && !(path_weight < witness.weights[target])) {
+          continue;
+        }
+        ++shortcut_count;
+        if (add_shortcuts) {
+          AddShortcut(state, in_edge_id, out_edge_id);
+        }
+      }
+    }
+    return shortcut_count;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::RunWitnessSearch(ContractionState& state, VertexId source,
+                                                            VertexId ignored_vertex, Weight max_weight) const {
+    auto& buffers = state.witness_buffers;
+    buffers.Reset(graph_.GetVertexCount());
+    buffers.Reach(source, 0, NO_EDGE);
+    size_t settled_count = 0;
+    while (settled_count++ < WITNESS_SETTLED_LIMIT) {
+      const auto vertex = buffers.PopClosest();
+      if (!vertex || max_weight < buffers.weights[*vertex]) {
+        return;
+      }
+      const Weight weight = buffers.weights[*vertex];
+      for (const HierarchyEdgeId edge_id : state.out_edges[*vertex]) {
+        const auto& edge = edges_[edge_id];
+        if (edge.to == ignored_vertex || state.contracted[edge.to]) {
+          continue;
+        }
+        const Weight candidate_weight = weight + edge.weight;
+        if (!buffers.IsReached(edge.to) || candidate_weight < buffers.weights[edge.to]) {
+          buffers.Reach(edge.to, candidate_weight, edge_id);
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  typename ContractionHierarchyRouter<Weight>::HierarchyEdgeId
+  ContractionHierarchyRouter<Weight>::AddShortcut(ContractionState& state,
+                                                  HierarchyEdgeId first_half, HierarchyEdgeId second_half) {
+    const HierarchyEdgeId edge_id = edges_.size();
+    const VertexId from = edges_[first_half].from;
+    const VertexId to = edges_[second_half].to;
+    edges_.Edit().push_back({
+        from, to,
+        edges_[first_half].weight + edges_[second_half].weight,
+        NO_EDGE, first_half, second_half
+    });
+    state.out_edges[from].push_back(edge_id);
+    state.in_edges[to].push_back(edge_id);
+    return edge_id;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::RunUpwardSearches(SearchBuffers<Weight>& forward,
+                                                             SearchBuffers<Weight>& backward,
+                                                             VertexId from, VertexId to,
+                                                             std::optional<VertexId>& meeting_vertex) const {
+    std::optional<Weight> best_weight;
+    auto update_meeting = [&](VertexId vertex) {
+      if (forward.IsReached(vertex) && backward.IsReached(vertex)) {
+        const Weight weight = forward.weights[vertex] + backward.weights[vertex];
+        if (!best_weight || weight < *best_weight) {
+          best_weight = weight;
+          meeting_vertex = vertex;
+        }
+      }
+    };
+    auto should_continue = [&best_weight](const SearchBuffers<Weight>& buffers) {
+      const auto closest_weight = buffers.PeekClosestWeight();
+      return closest_weight && (!best_weight || *closest_weight < *best_weight);
+    };
+    auto settle_closest = [&update_meeting](SearchBuffers<Weight>& buffers, const Graph& graph) {
+      const auto vertex = buffers.PopClosest();
+      if (!vertex) {
+        return;
+      }
+      update_meeting(*vertex);
+      const Weight weight = buffers.weights[*vertex];
+      const auto edges = graph.GetIncidentEdgesSlice(*vertex);
+      for (size_t edge_idx = 0; edge_idx < edges.size; ++edge_idx) {
+        const VertexId target = edges.targets[edge_idx];
+        const Weight candidate_weight = weight + edges.weights[edge_idx];
+        if (!buffers.IsReached(target) || candidate_weight < buffers.weights[target]) {
+          buffers.Reach(target, candidate_weight, edges.edge_ids[edge_idx]);
+        }
+      }
+    };
+
+    forward.Reach(from, 0, NO_EDGE);
+    backward.Reach(to, 0, NO_EDGE);
+    update_meeting(from);
+    while (should_continue(forward) || should_continue(backward)) {
+      if (should_continue(forward)) {
+        settle_closest(forward, upward_graph_);
+      }
+      if (should_continue(backward)) {
+        settle_closest(backward, downward_graph_);
+      }
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::UnpackEdges(std::vector<HierarchyEdgeId>& stack,
+                                                       std::vector<EdgeId>& edges) const {
+    while (!stack.empty()) {
+      const auto& edge = edges_[stack.back()];
+      stack.pop_back();
+      if (edge.original_edge != NO_EDGE) {
+        edges.push_back(edge.original_edge);
+      } else {
+        stack.push_back(edge.second_half);
+        stack.push_back(edge.first_half);
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<Weight> ContractionHierarchyRouter<Weight>::BuildRoute(VertexId from, VertexId to,
+                                                                       std::vector<EdgeId>& route_edges) const {
+    thread_local SearchBuffers<Weight> forward;
+    thread_local SearchBuffers<Weight> backward;
+    thread_local std::vector<HierarchyEdgeId> stack;
+    forward.Reset(graph_.GetVertexCount());
+    backward.Reset(graph_.GetVertexCount());
+
+    std::optional<VertexId> meeting_vertex;
+    RunUpwardSearches(forward, backward, from, to, meeting_vertex);
+    if (!meeting_vertex) {
+      return std::nullopt;
+    }
+
+    route_edges.clear();
+    // Walking back from the meeting vertex leaves the first edge of the upward part on top
+    for (EdgeId edge_id = forward.prev_edges[*meeting_vertex];
+         edge_id != NO_EDGE;
+         edge_id = forward.prev_edges[upward_graph_.GetEdge(edge_id).from]) {
+      stack.push_back(upward_hierarchy_edges_[edge_id]);
+    }
+    UnpackEdges(stack, route_edges);
+    // The downward part is walked in route order, so it has to be flipped
+    for (EdgeId edge_id = backward.prev_edges[*meeting_vertex];
+         edge_id != NO_EDGE;
+         edge_id = backward.prev_edges[downward_graph_.GetEdge(edge_id).from]) {
+      stack.push_back(downward_hierarchy_edges_[edge_id]);
+    }
+    std::reverse(std::begin(stack), std::end(stack));
+    UnpackEdges(stack, route_edges);
+
+    return forward.weights[*meeting_vertex] + backward.weights[*meeting_vertex];
+  }
+
+  template <typename Weight>
+  std::optional<typename ContractionHierarchyRouter<Weight>::RouteInfo>
+  ContractionHierarchyRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    std::vector<EdgeId> edges;
+    const auto weight = BuildRoute(from, to, edges);
+    if (!weight) {
+      return std::nullopt;
+    }
+    const size_t route_edge_count = edges.size();
+    return RouteInfo{expanded_routes_.Add(std::move(edges)), *weight, route_edge_count};
+  }
+
+  template <typename Weight>
+  EdgeId ContractionHierarchyRouter<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+    return expanded_routes_.GetEdge(route_id, edge_idx);
+  }
+
+  template <typename Weight>
+  void ContractionHierarchyRouter<Weight>::ReleaseRoute(RouteId route_id) {
+    expanded_routes_.Release(route_id);
+  }
+
+}
@@ -20,46 +20,40 @@ namespace Descriptions {
     return stop;
   }
 
-  static vector<string> ParseStops(const Json::Array& stop_nodes, bool is_roundtrip) {
+  static vector<string> ParseStops(const Json::Array& stop_nodes) {
     vector<string> stops;
     stops.reserve(stop_nodes.size());
     for (const Json::Node& stop_node : stop_nodes) {
       stops.push_back(stop_node.AsString());
     }
-    if (is_roundtrip || stops.size() <= 1) {
-      return stops;
-    }
-    stops.reserve(stops.size() * 2 - 1);  // end stop is not repeated
-    for (size_t stop_idx = stops.size() - 1; stop_idx > 0; --stop_idx) {
-      stops.push_back(stops[stop_idx - 1]);
-    }
     return stops;
   }
 
-  int ComputeStopsDistance(const Stop& lhs, const Stop& rhs) {
-    if (auto it = lhs.distances.find(rhs.name); it != lhs.distances.end()) {
-      return it->second;
-    } else {
-      return rhs.distances.at(lhs.name);
-    }
+  Bus Bus::ParseFrom(const Json::Dict& attrs) {
+    return Make(attrs.at("name").AsString(),
+                ParseStops(attrs.at("stops").AsArray()),
+                attrs.at("is_roundtrip").AsBool());
   }
 
-  Bus Bus::ParseFrom(const Json::Dict& attrs) {
-    const auto& name = attrs.at("name").AsString();
-    const auto& stops = attrs.at("stops").AsArray();
-    if (stops.empty()) {
-      return Bus{.name = name};
-    } else {
-      Bus bus{
-          .name = name,
-          .stops = ParseStops(stops, attrs.at("is_roundtrip").AsBool()),
-          .endpoints = {stops.front().AsString(), stops.back().AsString()}
-      };
-      if (bus.endpoints.back() == bus.endpoints.front()) {
-        bus.endpoints.pop_back();
+  Bus Bus::Make(string name, vector<string> stop_names, bool is_roundtrip) {
+    if (stop_names.empty()) {
+      return Bus{.name = move(name)};
+    }
+    Bus bus{
+        .name = move(name),
+        .endpoints = {stop_names.front(), stop_names.back()}
+    };
+    if (bus.endpoints.back() == bus.endpoints.front()) {
+      bus.endpoints.pop_back();
+    }
+    bus.stops = move(stop_names);
+    if (!is_roundtrip && bus.stops.size() > 1) {
+      bus.stops.reserve(bus.stops.size() * 2 - 1);  // end stop is not repeated
+      for (size_t stop_idx = bus.stops.size() - 1; stop_idx > 0; --stop_idx) {
+        bus.stops.push_back(bus.stops[stop_idx - 1]);
       }
-      return bus;
     }
+    return bus;
   }
 
   vector<InputQuery> ReadDescriptions(const Json::Array& nodes) {
@@ -78,4 +72,84 @@ namespace Descriptions {
     return result;
   }
 
+  void QueriesReader::StartArray() {
+    ++depth_;
+  }
+
+  void QueriesReader::EndArray() {
+    --depth_;
+  }
+
+  void QueriesReader::StartObject() {
+    if (++depth_ == 2) {
+      attributes_ = {};
+    }
+  }
+
+  void QueriesReader::Key(string_view key) {
+    if (depth_ == 2) {
+      attribute_name_ = key;
+    } else if (depth_ == 3) {
+      neighbour_stop_ = key;
+    }
+  }
+
+  void QueriesReader::EndObject() {
+    if (depth_-- != 2) {
+      return;
+    }
+    if (attributes_.type == "Bus") {
+      queries_.push_back(Bus::Make(move(attributes_.name), move(attributes_.stops), attributes_.is_roundtrip));
+    } else {
+      queries_.push_back(Stop{
+          .name = move(attributes_.name),
+          .position = attributes_.position,
+          .distances = move(attributes_.distances),
+      });
+    }
+  }
+
+  void QueriesReader::Bool(bool value) {
+    if (depth_ == 2 && attribute_name_ == "is_roundtrip") {
+      attributes_.is_roundtrip = value;
+    }
+  }
+
+  void QueriesReader::Number(int value) {
+    if (depth_ == 3 && attribute_name_ == "road_distances") {
+      attributes_.distances[neighbour_stop_] = value;
+    } else {
+      SetNumber(value);
+    }
+  }
+
+  void QueriesReader::Number(double value) {
+    SetNumber(value);
+  }
+
+  void QueriesReader::SetNumber(double value) {
+    if (depth_ != 2) {
+      return;
+    }
+    if (attribute_name_ == "latitude") {
+      attributes_.position.latitude = value;
+    } else if (attribute_name_ == "longitude") {
+      attributes_.position.longitude = value;
+    }
+  }
+
+  void QueriesReader::String(string_view value) {
+    if (depth_ == 2 && attribute_name_ == "type") {
+      attributes_.type = value;
+    } else if (depth_ == 2 && attribute_name_ == "name") {
+      attributes_.name = value;
+    } else if (depth_ == 3 && attribute_name_ == "stops") {
+      attributes_.stops.emplace_back(value);
+    }
+  }
+
+  vector<InputQuery> QueriesReader::ExtractQueries() {
+    return move(queries_);
+  }
+
 }
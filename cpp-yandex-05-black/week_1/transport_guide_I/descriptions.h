@@ -5,6 +5,7 @@
 
 #include <map>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
@@ -20,22 +21,61 @@ namespace Descriptions {
     static Stop ParseFrom(const Json::Dict& attrs);
   };
 
-  int ComputeStopsDistance(const Stop& lhs, const Stop& rhs);
-
   struct Bus {
     std::string name;
     std::vector<std::string> stops;
     std::vector<std::string> endpoints;
 
     static Bus ParseFrom(const Json::Dict& attrs);
+
+    // stop_names are the listed ones, i.e. only the way there for non-roundtrip buses
+    static Bus Make(std::string name, std::vector<std::string> stop_names, bool is_roundtrip);
   };
 
   using InputQuery = std::variant<Stop, Bus>;
 
   std::vector<InputQuery> ReadDescriptions(const Json::Array& nodes);
 
+  // Builds queries from the events of a base requests array as they arrive,
+  // so that no tree of the array is ever built
+  class QueriesReader : public Json::Handler {
+  public:
+    void StartArray() override;
+    void EndArray() override;
+    void StartObject() override;
+    void Key(std::string_view key) override;
+    void EndObject() override;
+    void Bool(bool value) override;
+    void Number(int value) override;
+    void Number(double value) override;
+    void String(std::string_view value) override;
+
+    std::vector<InputQuery> ExtractQueries();
+
+  private:
+    // Attributes of the query being read, its type tells which of them are used
+    struct QueryAttributes {
+      std::string type;
+      std::string name;
+      Sphere::Point position;
+      std::unordered_map<std::string, int> distances;
+      std::vector<std::string> stops;
+      bool is_roundtrip = false;
+    };
+
+    std::vector<InputQuery> queries_;
+    QueryAttributes attributes_;
+    std::string attribute_name_;
+    std::string neighbour_stop_;
+    // 1 inside the requests array, 2 inside a query, 3 inside its stops or road_distances
+    int depth_ = 0;
+
+    void SetNumber(double value);
+  };
+
+  // Transparent, so that names can be looked up by string_view
   template <typename Object>
-  using Dict = std::map<std::string, const Object*>;
+  using Dict = std::map<std::string, const Object*, std::less<>>;
 
   using StopsDict = Dict<Stop>;
   using BusesDict = Dict<Bus>;
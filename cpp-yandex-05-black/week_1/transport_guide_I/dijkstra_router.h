@@ -0,0 +1,133 @@
+#pragma once
+
+#include "expanded_routes.h"
+#include "graph.h"
+#include "search_buffers.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Same interface as Router, but nothing is precomputed:
+  // every BuildRoute runs Dijkstra from scratch.
+  // Construction is O(1) and memory is O(V) per thread instead of O(V^2).
+  // The graph must be frozen, the search scans its compressed rows.
+  template <typename Weight>
+  class DijkstraRouter {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    DijkstraRouter(const Graph& graph);
+    // Nothing is precomputed, so nothing is read
+    DijkstraRouter(const Graph& graph, Snapshot::Reader&) : DijkstraRouter(graph) {}
+
+    using RouteId = ExpandedRoutes::RouteId;
+
+    struct RouteInfo {
+      RouteId id;
+      Weight weight;
+      size_t edge_count;
+    };
+
+    // Replaces the contents of route_edges with the route edges and returns the route weight.
+    // Reuses the buffer capacity and keeps no state, so nothing has to be released.
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, std::vector<EdgeId>& route_edges) const;
+
+    // Same route kept inside the router until ReleaseRoute
+    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
+    void ReleaseRoute(RouteId route_id);
+
+    void Serialize(Snapshot::Writer&) const {}
+
+  private:
+    const Graph& graph_;
+
+    mutable ExpandedRoutes expanded_routes_;
+
+    static SearchBuffers<Weight>& GetSearchBuffers(size_t vertex_count);
+
+    void RunSearch(SearchBuffers<Weight>& buffers, VertexId from, VertexId to) const;
+  };
+
+
+  template <typename Weight>
+  DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph) : graph_(graph) {
+    assert(graph.IsFrozen());
+  }
+
+  template <typename Weight>
+  SearchBuffers<Weight>& DijkstraRouter<Weight>::GetSearchBuffers(size_t vertex_count) {
+    thread_local SearchBuffers<Weight> buffers;
+    buffers.Reset(vertex_count);
+    return buffers;
+  }
+
+  template <typename Weight>
+  void DijkstraRouter<Weight>::RunSearch(SearchBuffers<Weight>& buffers, VertexId from, VertexId to) const {
+    buffers.Reach(from, 0, NO_EDGE);
+    while (const auto vertex = buffers.PopClosest()) {
+      if (*vertex == to) {
+        return;
+      }
+      const Weight weight = buffers.weights[*vertex];
+      const auto edges = graph_.GetIncidentEdgesSlice(*vertex);
+      for (size_t edge_idx = 0; edge_idx < edges.size; ++edge_idx) {
+        assert(edges.weights[edge_idx] >= 0);
+        const VertexId target = edges.targets[edge_idx];
+        const Weight candidate_weight = weight + edges.weights[edge_idx];
+        if (!buffers.IsReached(target) || candidate_weight < buffers.weights[target]) {
+          buffers.Reach(target, candidate_weight, edges.edge_ids[edge_idx]);
+        }
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<Weight> DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to,
+                                                           std::vector<EdgeId>& route_edges) const {
+    auto& buffers = GetSearchBuffers(graph_.GetVertexCount());
+    RunSearch(buffers, from, to);
+    if (!buffers.IsReached(to)) {
+      return std::nullopt;
+    }
+
+    route_edges.clear();
+    for (EdgeId edge_id = buffers.prev_edges[to];
+         edge_id != NO_EDGE;
+         edge_id = buffers.prev_edges[graph_.GetEdge(edge_id).from]) {
+      route_edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(route_edges), std::end(route_edges));
+    return buffers.weights[to];
+  }
+
+  template <typename Weight>
+  std::optional<typename DijkstraRouter<Weight>::RouteInfo>
+  DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    std::vector<EdgeId> edges;
+    const auto weight = BuildRoute(from, to, edges);
+    if (!weight) {
+      return std::nullopt;
+    }
+    const size_t route_edge_count = edges.size();
+    return RouteInfo{expanded_routes_.Add(std::move(edges)), *weight, route_edge_count};
+  }
+
+  template <typename Weight>
+  EdgeId DijkstraRouter<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+    return expanded_routes_.GetEdge(route_id, edge_idx);
+  }
+
+  template <typename Weight>
+  void DijkstraRouter<Weight>::ReleaseRoute(RouteId route_id) {
+    expanded_routes_.Release(route_id);
+  }
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Edges of routes built by a router and not released yet.
+  // Thread-safe, so that one router can serve several threads.
+  class ExpandedRoutes {
+  public:
+    using RouteId = uint64_t;
+
+    RouteId Add(std::vector<EdgeId> edges) {
+      std::lock_guard lock(mutex_);
+      const RouteId route_id = next_route_id_++;
+      routes_[route_id] = std::move(edges);
+      return route_id;
+    }
+
+    EdgeId GetEdge(RouteId route_id, size_t edge_idx) const {
+      std::lock_guard lock(mutex_);
+      return routes_.at(route_id)[edge_idx];
+    }
+
+    void Release(RouteId route_id) {
+      std::lock_guard lock(mutex_);
+      routes_.erase(route_id);
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    RouteId next_route_id_ = 0;
+    std::unordered_map<RouteId, std::vector<EdgeId>> routes_;
+  };
+
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "snapshot.h"
 #include "utils.h"
 
+#include <cassert>
 #include <cstdlib>
 #include <deque>
 #include <vector>
@@ -22,37 +24,113 @@ namespace Graph {
   class DirectedWeightedGraph {
   private:
     using IncidenceList = std::vector<EdgeId>;
-    using IncidentEdgesRange = Range<typename IncidenceList::const_iterator>;
+    using IncidentEdgesRange = Range<const EdgeId*>;
 
   public:
     DirectedWeightedGraph(size_t vertex_count = 0);
+    // Frozen graph written by Serialize, viewed in the mapping of the reader
+    explicit DirectedWeightedGraph(Snapshot::Reader& reader);
     EdgeId AddEdge(const Edge<Weight>& edge);
 
+    // Converts incidence lists into compressed sparse row form:
+    // incident edges of all vertices become contiguous arrays sorted by source vertex.
+    // Edges can't be added to a frozen graph.
+    void Freeze();
+    bool IsFrozen() const;
+
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // Incident edges of a vertex of a frozen graph: parallel arrays of equal size
+    struct IncidentEdgesSlice {
+      const VertexId* targets;
+      const Weight* weights;
+      const EdgeId* edge_ids;
+      size_t size;
+    };
+    IncidentEdgesSlice GetIncidentEdgesSlice(VertexId vertex) const;
+
+    // Only a frozen graph can be serialized
+    void Serialize(Snapshot::Writer& writer) const;
+
   private:
-    std::vector<Edge<Weight>> edges_;
+    Snapshot::Array<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
+
+    // Compressed sparse row form, filled by Freeze:
+    // edges of vertex v occupy positions [offsets_[v], offsets_[v + 1]) of the other arrays
+    Snapshot::Array<size_t> offsets_;
+    Snapshot::Array<VertexId> targets_;
+    Snapshot::Array<Weight> weights_;
+    Snapshot::Array<EdgeId> edge_ids_;
   };
 
 
   template <typename Weight>
   DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
 
+  template <typename Weight>
+  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(Snapshot::Reader& reader)
+      : edges_(reader.ReadMappedArray<Edge<Weight>>()),
+        offsets_(reader.ReadMappedArray<size_t>()),
+        targets_(reader.ReadMappedArray<VertexId>()),
+        weights_(reader.ReadMappedArray<Weight>()),
+        edge_ids_(reader.ReadMappedArray<EdgeId>())
+  {
+    if (offsets_.empty() || offsets_.back() != edge_ids_.size()
+        || targets_.size() != edge_ids_.size() || weights_.size() != edge_ids_.size()) {
+      throw Snapshot::FormatError("malformed graph");
+    }
+  }
+
   template <typename Weight>
   EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
-    edges_.push_back(edge);
+    assert(!IsFrozen());
+    edges_.Edit().push_back(edge);
     const EdgeId id = edges_.size() - 1;
     incidence_lists_[edge.from].push_back(id);
     return id;
   }
 
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::Freeze() {
+    if (IsFrozen()) {
+      return;
+    }
+    const size_t vertex_count = incidence_lists_.size();
+    auto& offsets = offsets_.Edit();
+    auto& targets = targets_.Edit();
+    auto& weights = weights_.Edit();
+    auto& edge_ids = edge_ids_.Edit();
+    offsets.reserve(vertex_count + 1);
+    targets.reserve(edges_.size());
+    weights.reserve(edges_.size());
+    edge_ids.reserve(edges_.size());
+
+    offsets.push_back(0);
+    for (const IncidenceList& incidence_list : incidence_lists_) {
+      for (const EdgeId edge_id : incidence_list) {
+        targets.push_back(edges_[edge_id].to);
+        weights.push_back(edges_[edge_id].weight);
+        edge_ids.push_back(edge_id);
+      }
+      offsets.push_back(edge_ids.size());
+    }
+
+    incidence_lists_.clear();
+    incidence_lists_.shrink_to_fit();
+  }
+
+  template <typename Weight>
+  bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return !offsets_.empty();
+  }
+
   template <typename Weight>
   size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return IsFrozen() ? offsets_.size() - 1 : incidence_lists_.size();
   }
 
   template <typename Weight>
@@ -68,7 +146,33 @@ namespace Graph {
   template <typename Weight>
   typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
   DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    if (IsFrozen()) {
+      return {edge_ids_.data() + offsets_[vertex], edge_ids_.data() + offsets_[vertex + 1]};
+    }
     const auto& edges = incidence_lists_[vertex];
-    return {std::begin(edges), std::end(edges)};
+    return {edges.data(), edges.data() + edges.size()};
+  }
+
+  template <typename Weight>
+  typename DirectedWeightedGraph<Weight>::IncidentEdgesSlice
+  DirectedWeightedGraph<Weight>::GetIncidentEdgesSlice(VertexId vertex) const {
+    assert(IsFrozen());
+    const size_t offset = offsets_[vertex];
+    return {
+        targets_.data() + offset,
+        weights_.data() + offset,
+        edge_ids_.data() + offset,
+        offsets_[vertex + 1] - offset
+    };
+  }
+
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::Serialize(Snapshot::Writer& writer) const {
+    assert(IsFrozen());
+    writer.WriteArray(edges_);
+    writer.WriteArray(offsets_);
+    writer.WriteArray(targets_);
+    writer.WriteArray(weights_);
+    writer.WriteArray(edge_ids_);
   }
 }
@@ -1,4 +1,8 @@
 #include "json.h"
+#include "json_scanner.h"
+
+#include <charconv>
+#include <iterator>
 
 using namespace std;
 
@@ -26,27 +30,11 @@ namespace Json {
   }
 
   Node LoadNumber(istream& input) {
-    bool is_negative = false;
-    if (input.peek() == '-') {
-      is_negative = true;
-      input.get();
-    }
-    int int_part = 0;
-    while (isdigit(input.peek())) {
-      int_part *= 10;
-      int_part += input.get() - '0';
-    }
-    if (input.peek() != '.') {
-      return Node(int_part * (is_negative ? -1 : 1));
-    }
-    input.get();  // '.'
-    double result = int_part;
-    double frac_mult = 0.1;
-    while (isdigit(input.peek())) {
-      result += frac_mult * (input.get() - '0');
-      frac_mult /= 10;
+    string token;
+    while (IsNumberChar(static_cast<char>(input.peek()))) {
+      token.push_back(input.get());
     }
-    return Node(result * (is_negative ? -1 : 1));
+    return visit([](auto number) { return Node(number); }, ParseNumber(token));
   }
 
   Node LoadString(istream& input) {
@@ -94,14 +82,301 @@ namespace Json {
     return Document{LoadNode(input)};
   }
 
+  namespace {
+
+    class BufferParser {
+    public:
+      explicit BufferParser(string_view input) : scanner_(input) {}
+
+      Node ParseDocument() {
+        Node root = ParseNode();
+        if (!scanner_.AtEnd()) {
+          throw ParsingError("unexpected data after the root value");
+        }
+        return root;
+      }
+
+    private:
+      Scanner scanner_;
+      string string_buffer_;
+
+      Node ParseNode() {
+        switch (scanner_.PeekToken()) {
+          case '[':
+            return ParseArray();
+          case '{':
+            return ParseDict();
+          case '"':
+            return Node(string(scanner_.ScanString(string_buffer_)));
+          case 't':
+          case 'f':
+            return Node(scanner_.ScanBool());
+          default:
+            return visit([](auto number) { return Node(number); }, scanner_.ScanNumber());
+        }
+      }
+
+      Node ParseArray() {
+        scanner_.Expect('[');
+        Array result;
+        if (!scanner_.Accept(']')) {
+          do {
+            result.push_back(ParseNode());
+          } while (scanner_.Accept(','));
+          scanner_.Expect(']');
+        }
+        return Node(move(result));
+      }
+
+      Node ParseDict() {
+        scanner_.Expect('{');
+        Dict result;
+        if (!scanner_.Accept('}')) {
+          do {
+            string key(scanner_.ScanString(string_buffer_));
+            scanner_.Expect(':');
+            result.emplace(move(key), ParseNode());
+          } while (scanner_.Accept(','));
+          scanner_.Expect('}');
+        }
+        return Node(move(result));
+      }
+    };
+
+  }
+
+  Document Load(string_view input) {
+    return Document{BufferParser(input).ParseDocument()};
+  }
+
+  namespace {
+
+    class EventReader {
+    public:
+      EventReader(string_view input, Handler& handler) : scanner_(input), handler_(handler) {}
+
+      void ReadDocument() {
+        ReadNode();
+        if (!scanner_.AtEnd()) {
+          throw ParsingError("unexpected data after the root value");
+        }
+      }
+
+    private:
+      Scanner scanner_;
+      Handler& handler_;
+      string string_buffer_;
+
+      void ReadNode() {
+        switch (scanner_.PeekToken()) {
+          case '[':
+            ReadArray();
+            break;
+          case '{':
+            ReadDict();
+            break;
+          case '"':
+            handler_.String(scanner_.ScanString(string_buffer_));
+            break;
+          case 't':
+          case 'f':
+            handler_.Bool(scanner_.ScanBool());
+            break;
+          default:
+            visit([this](auto number) { handler_.Number(number); }, scanner_.ScanNumber());
+        }
+      }
+
+      void ReadArray() {
+        scanner_.Expect('[');
+        handler_.StartArray();
+        if (!scanner_.Accept(']')) {
+          do {
+            ReadNode();
+          } while (scanner_.Accept(','));
+          scanner_.Expect(']');
+        }
+        handler_.EndArray();
+      }
+
+      void ReadDict() {
+        scanner_.Expect('{');
+        handler_.StartObject();
+        if (!scanner_.Accept('}')) {
+          do {
+            handler_.Key(scanner_.ScanString(string_buffer_));
+            scanner_.Expect(':');
+            ReadNode();
+          } while (scanner_.Accept(','));
+          scanner_.Expect('}');
+        }
+        handler_.EndObject();
+      }
+    };
+
+  }
+
+  void Read(string_view input, Handler& handler) {
+    EventReader(input, handler).ReadDocument();
+  }
+
+  template <typename Event>
+  bool NodeBuilder::ForwardToMemberHandler(Event event, int depth_change) {
+    if (!member_handler_) {
+      return false;
+    }
+    event(*member_handler_);
+    member_depth_ += depth_change;
+    if (member_depth_ == 0) {
+      member_handler_ = nullptr;
+    }
+    return true;
+  }
+
+  void NodeBuilder::AddValue(Node value) {
+    if (frames_.empty()) {
+      root_ = move(value);
+    } else if (auto* array = get_if<Array>(&frames_.back().container)) {
+      array->push_back(move(value));
+    } else {
+      get<Dict>(frames_.back().container).emplace(move(frames_.back().key), move(value));
+    }
+  }
+
+  void NodeBuilder::EndContainer() {
+    Node container = visit([](auto& value) { return Node(move(value)); }, frames_.back().container);
+    frames_.pop_back();
+    AddValue(move(container));
+  }
+
+  void NodeBuilder::StartArray() {
+    if (!ForwardToMemberHandler([](Handler& handler) { handler.StartArray(); }, 1)) {
+      frames_.push_back({Array{}, {}});
+    }
+  }
+
+  void NodeBuilder::EndArray() {
+    if (!ForwardToMemberHandler([](Handler& handler) { handler.EndArray(); }, -1)) {
+      EndContainer();
+    }
+  }
+
+  void NodeBuilder::StartObject() {
+    if (!ForwardToMemberHandler([](Handler& handler) { handler.StartObject(); }, 1)) {
+      frames_.push_back({Dict{}, {}});
+    }
+  }
+
+  void NodeBuilder::Key(string_view key) {
+    if (ForwardToMemberHandler([key](Handler& handler) { handler.Key(key); })) {
+      return;
+    }
+    if (frames_.size() == 1) {
+      if (auto it = member_handlers_.find(string(key)); it != member_handlers_.end()) {
+        member_handler_ = it->second;
+        return;
+      }
+    }
+    frames_.back().key = key;
+  }
+
+  void NodeBuilder::EndObject() {
+    if (!ForwardToMemberHandler([](Handler& handler) { handler.EndObject(); }, -1)) {
+      EndContainer();
+    }
+  }
+
+  void NodeBuilder::Bool(bool value) {
+    if (!ForwardToMemberHandler([value](Handler& handler) { handler.Bool(value); })) {
+      AddValue(Node(value));
+    }
+  }
+
+  void NodeBuilder::Number(int value) {
+    if (!ForwardToMemberHandler([value](Handler& handler) { handler.Number(value); })) {
+      AddValue(Node(value));
+    }
+  }
+
+  void NodeBuilder::Number(double value) {
+    if (!ForwardToMemberHandler([value](Handler& handler) { handler.Number(value); })) {
+      AddValue(Node(value));
+    }
+  }
+
+  void NodeBuilder::String(string_view value) {
+    if (!ForwardToMemberHandler([value](Handler& handler) { handler.String(value); })) {
+      AddValue(Node(string(value)));
+    }
+  }
+
+  Node NodeBuilder::ExtractRoot() {
+    return move(root_.value());
+  }
+
+  static string_view FormatInt(int value, char (&buffer)[32]) {
+    return {buffer, static_cast<size_t>(to_chars(begin(buffer), end(buffer), value).ptr - buffer)};
+  }
+
+  // Same text as the default stream formatting (%g with precision 6), but locale-free
+  static string_view FormatDouble(double value, char (&buffer)[32]) {
+    const auto result = to_chars(begin(buffer), end(buffer), value, chars_format::general, 6);
+    return {buffer, static_cast<size_t>(result.ptr - buffer)};
+  }
+
+  // Escape sequence of a character that can't appear in a string as is, empty for the others
+  static string_view EscapeChar(char c, char (&buffer)[8]) {
+    switch (c) {
+      case '"':
+        return "\\\"";
+      case '\\':
+        return "\\\\";
+      case '\b':
+        return "\\b";
+      case '\f':
+        return "\\f";
+      case '\n':
+        return "\\n";
+      case '\r':
+        return "\\r";
+      case '\t':
+        return "\\t";
+      default:
+        break;
+    }
+    if (static_cast<unsigned char>(c) >= 0x20) {
+      return {};
+    }
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    const string_view prefix = "\\u00";
+    prefix.copy(buffer, prefix.size());
+    buffer[prefix.size()] = HEX_DIGITS[c >> 4];
+    buffer[prefix.size() + 1] = HEX_DIGITS[c & 0xf];
+    return {buffer, prefix.size() + 2};
+  }
+
+  template <>
+  void PrintValue<int>(const int& value, ostream& output) {
+    char buffer[32];
+    output << FormatInt(value, buffer);
+  }
+
+  template <>
+  void PrintValue<double>(const double& value, ostream& output) {
+    char buffer[32];
+    output << FormatDouble(value, buffer);
+  }
+
   template <>
   void PrintValue<string>(const string& value, ostream& output) {
     output << '"';
+    char buffer[8];
     for (const char c : value) {
-      if (c == '"' || c == '\\') {
-        output << '\\';
+      if (const string_view escaped = EscapeChar(c, buffer); !escaped.empty()) {
+        output << escaped;
+      } else {
+        output << c;
       }
-      output << c;
     }
     output << '"';
   }
@@ -150,4 +425,108 @@ namespace Json {
     PrintNode(document.GetRoot(), output);
   }
 
+  void Writer::StartItem() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (!has_items_.empty()) {
+      if (has_items_.back()) {
+        output_ += ", ";
+      }
+      has_items_.back() = true;
+    }
+  }
+
+  Writer& Writer::StartArray() {
+    StartItem();
+    output_ += '[';
+    has_items_.push_back(false);
+    return *this;
+  }
+
+  Writer& Writer::EndArray() {
+    output_ += ']';
+    has_items_.pop_back();
+    return *this;
+  }
+
+  Writer& Writer::StartObject() {
+    StartItem();
+    output_ += '{';
+    has_items_.push_back(false);
+    return *this;
+  }
+
+  Writer& Writer::Key(string_view key) {
+    StartItem();
+    AppendString(key);
+    output_ += ": ";
+    after_key_ = true;
+    return *this;
+  }
+
+  Writer& Writer::EndObject() {
+    output_ += '}';
+    has_items_.pop_back();
+    return *this;
+  }
+
+  Writer& Writer::Value(bool value) {
+    StartItem();
+    output_ += value ? "true" : "false";
+    return *this;
+  }
+
+  Writer& Writer::Value(int value) {
+    StartItem();
+    char buffer[32];
+    output_ += FormatInt(value, buffer);
+    return *this;
+  }
+
+  Writer& Writer::Value(double value) {
+    StartItem();
+    char buffer[32];
+    output_ += FormatDouble(value, buffer);
+    return *this;
+  }
+
+  Writer& Writer::Value(string_view value) {
+    StartItem();
+    AppendString(value);
+    return *this;
+  }
+
+  Writer& Writer::Value(const PrintedValue& value, int missing_int) {
+    StartItem();
+    char buffer[32];
+    output_ += value.prefix;
+    output_ += FormatInt(missing_int, buffer);
+    output_ += value.suffix;
+    return *this;
+  }
+
+  Writer& Writer::RawValue(string_view value) {
+    StartItem();
+    output_ += value;
+    return *this;
+  }
+
+  void Writer::AppendString(string_view value) {
+    output_ += '"';
+    // Runs without characters to escape are appended at once
+    size_t run_begin = 0;
+    char buffer[8];
+    for (size_t pos = 0; pos < value.size(); ++pos) {
+      if (const string_view escaped = EscapeChar(value[pos], buffer); !escaped.empty()) {
+        output_.append(value, run_begin, pos - run_begin);
+        output_ += escaped;
+        run_begin = pos + 1;
+      }
+    }
+    output_.append(value, run_begin);
+    output_ += '"';
+  }
+
 }
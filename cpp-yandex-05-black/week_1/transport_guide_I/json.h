@@ -2,7 +2,10 @@
 
 #include <iostream>
 #include <map>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -80,6 +83,77 @@ namespace Json {
 
   Document Load(std::istream& input);
 
+  class ParsingError : public std::runtime_error {
+  public:
+    using runtime_error::runtime_error;
+  };
+
+  // Builds the same tree as Load(istream&) from a contiguous buffer,
+  // e.g. a whole file read at once. Handles escape sequences in strings.
+  Document Load(std::string_view input);
+
+  // Receives the events of Read in document order.
+  // Keys and strings are valid only during the call.
+  class Handler {
+  public:
+    virtual ~Handler() = default;
+
+    virtual void StartArray() = 0;
+    virtual void EndArray() = 0;
+    virtual void StartObject() = 0;
+    virtual void Key(std::string_view key) = 0;
+    virtual void EndObject() = 0;
+    virtual void Bool(bool value) = 0;
+    virtual void Number(int value) = 0;
+    virtual void Number(double value) = 0;
+    virtual void String(std::string_view value) = 0;
+  };
+
+  // Streams the document in the buffer to the handler without building any tree
+  void Read(std::string_view input, Handler& handler);
+
+  // Builds a Node tree from events.
+  // Values of the given root object members are passed to their own handlers instead,
+  // so that large parts of a document can be consumed without a tree.
+  class NodeBuilder : public Handler {
+  public:
+    explicit NodeBuilder(std::map<std::string, Handler*> member_handlers = {})
+        : member_handlers_(move(member_handlers)) {}
+
+    void StartArray() override;
+    void EndArray() override;
+    void StartObject() override;
+    void Key(std::string_view key) override;
+    void EndObject() override;
+    void Bool(bool value) override;
+    void Number(int value) override;
+    void Number(double value) override;
+    void String(std::string_view value) override;
+
+    Node ExtractRoot();
+
+  private:
+    // Container being built and the key of its next member
+    struct Frame {
+      std::variant<Array, Dict> container;
+      std::string key;
+    };
+
+    std::map<std::string, Handler*> member_handlers_;
+    std::vector<Frame> frames_;
+    std::optional<Node> root_;
+
+    // Receives events until the current member value ends
+    Handler* member_handler_ = nullptr;
+    int member_depth_ = 0;
+
+    template <typename Event>
+    bool ForwardToMemberHandler(Event event, int depth_change = 0);
+
+    void AddValue(Node value);
+    void EndContainer();
+  };
+
   void PrintNode(const Node& node, std::ostream& output);
 
   template <typename Value>
@@ -87,6 +161,12 @@ namespace Json {
     output << value;
   }
 
+  template <>
+  void PrintValue<int>(const int& value, std::ostream& output);
+
+  template <>
+  void PrintValue<double>(const double& value, std::ostream& output);
+
   template <>
   void PrintValue<std::string>(const std::string& value, std::ostream& output);
 
@@ -101,5 +181,46 @@ namespace Json {
 
   void Print(const Document& document, std::ostream& output);
 
+  // Value printed ahead of time except for one int inside it,
+  // e.g. a response without its request_id, so that writing it prints only that int
+  struct PrintedValue {
+    std::string prefix;  // text before the missing int
+    std::string suffix;  // text after it
+  };
+
+  // Appends values straight to a text buffer, in the format of PrintValue.
+  // Keys are written in the given order, so objects match Dict output only if written sorted.
+  class Writer {
+  public:
+    explicit Writer(std::string& output) : output_(output) {}
+
+    Writer& StartArray();
+    Writer& EndArray();
+    Writer& StartObject();
+    Writer& Key(std::string_view key);
+    Writer& EndObject();
+
+    Writer& Value(bool value);
+    Writer& Value(int value);
+    Writer& Value(double value);
+    Writer& Value(std::string_view value);
+    Writer& Value(const char* value) {
+      return Value(std::string_view(value));
+    }
+    Writer& Value(const PrintedValue& value, int missing_int);
+
+    // Appends an already printed value as is; an empty one leaves a place for a PrintedValue int
+    Writer& RawValue(std::string_view value);
+
+  private:
+    std::string& output_;
+    // Whether each open container already has items
+    std::vector<bool> has_items_;
+    bool after_key_ = false;
+
+    void StartItem();
+    void AppendString(std::string_view value);
+  };
+
 }
 
@@ -0,0 +1,104 @@
+#include "json.h"
+#include "json_scanner.h"
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+// Number parsing as it was before ParseNumber, kept for comparison
+double LegacyParseNumber(string_view token) {
+  bool is_negative = false;
+  if (token.front() == '-') {
+    is_negative = true;
+    token.remove_prefix(1);
+  }
+  int int_part = 0;
+  while (!token.empty() && isdigit(token.front())) {
+    int_part = int_part * 10 + (token.front() - '0');
+    token.remove_prefix(1);
+  }
+  if (token.empty()) {
+    return int_part * (is_negative ? -1 : 1);
+  }
+  token.remove_prefix(1);  // '.'
+  double result = int_part;
+  double frac_mult = 0.1;
+  while (!token.empty() && isdigit(token.front())) {
+    result += frac_mult * (token.front() - '0');
+    frac_mult /= 10;
+    token.remove_prefix(1);
+  }
+  return result * (is_negative ? -1 : 1);
+}
+
+// Latitudes and longitudes printed like those of base requests
+vector<string> MakeCoordinateTokens(size_t count) {
+  mt19937 generator;
+  uniform_real_distribution<double> coordinates(-180, 180);
+  vector<string> tokens;
+  tokens.reserve(count);
+  for (size_t idx = 0; idx < count; ++idx) {
+    ostringstream token;
+    token.precision(8);
+    token << fixed << coordinates(generator);
+    tokens.push_back(token.str());
+  }
+  return tokens;
+}
+
+int main() {
+  const vector<string> tokens = MakeCoordinateTokens(2'000'000);
+  // Printed in the end, so that the measured loops are not optimized out
+  size_t checksum = 0;
+
+  vector<double> legacy_values;
+  legacy_values.reserve(tokens.size());
+  {
+    LOG_DURATION("legacy parsing");
+    for (const string& token : tokens) {
+      legacy_values.push_back(LegacyParseNumber(token));
+    }
+  }
+  vector<double> values;
+  values.reserve(tokens.size());
+  {
+    LOG_DURATION("Json::ParseNumber");
+    for (const string& token : tokens) {
+      values.push_back(get<double>(Json::ParseNumber(token)));
+    }
+  }
+  double max_legacy_error = 0;
+  for (size_t idx = 0; idx < values.size(); ++idx) {
+    max_legacy_error = max(max_legacy_error, abs(values[idx] - legacy_values[idx]));
+  }
+  cerr << "max legacy parsing error: " << max_legacy_error << endl;
+
+  {
+    LOG_DURATION("ostream formatting");
+    ostringstream output;
+    for (const double value : values) {
+      output << value << ' ';
+    }
+    checksum += output.str().size();
+  }
+  {
+    LOG_DURATION("Json::PrintValue");
+    ostringstream output;
+    for (const double value : values) {
+      Json::PrintValue(value, output);
+      output << ' ';
+    }
+    checksum += output.str().size();
+  }
+
+  cerr << "checksum: " << checksum << endl;
+  return 0;
+}
@@ -0,0 +1,255 @@
+#include "json.h"
+#include "json_scanner.h"
+
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <system_error>
+
+using namespace std;
+
+namespace Json {
+
+  static bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  bool IsNumberChar(char c) {
+    return IsDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+  }
+
+  // Plain decimals with at most 15 digits, i.e. almost all numbers of our inputs.
+  // Their digits and the power of ten are exact doubles, so one division gives
+  // the correctly rounded value, as from_chars would.
+  static optional<variant<int, double>> ParsePlainNumber(string_view token) {
+    static constexpr double POWERS_OF_TEN[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+    };
+    static constexpr ptrdiff_t MAX_DIGIT_COUNT = 15;
+    static constexpr ptrdiff_t MAX_INT_DIGIT_COUNT = 9;  // always fit into int
+
+    const char* pos = token.data();
+    const char* const end = pos + token.size();
+    const bool is_negative = pos != end && *pos == '-';
+    if (is_negative) {
+      ++pos;
+    }
+    uint64_t digits = 0;
+    const char* const int_begin = pos;
+    for (; pos != end && IsDigit(*pos); ++pos) {
+      digits = digits * 10 + (*pos - '0');
+    }
+    const ptrdiff_t int_digit_count = pos - int_begin;
+    if (int_digit_count == 0) {
+      return nullopt;
+    }
+    if (pos == end) {
+      if (int_digit_count > MAX_INT_DIGIT_COUNT) {
+        return nullopt;
+      }
+      const int value = static_cast<int>(digits);
+      return is_negative ? -value : value;
+    }
+
+    if (*pos != '.') {
+      return nullopt;
+    }
+    const char* const fraction_begin = ++pos;
+    for (; pos != end && IsDigit(*pos); ++pos) {
+      digits = digits * 10 + (*pos - '0');
+    }
+    const ptrdiff_t fraction_digit_count = pos - fraction_begin;
+    if (pos != end || int_digit_count + fraction_digit_count > MAX_DIGIT_COUNT) {
+      return nullopt;
+    }
+    const double value = static_cast<double>(digits) / POWERS_OF_TEN[fraction_digit_count];
+    return is_negative ? -value : value;
+  }
+
+  variant<int, double> ParseNumber(string_view token) {
+    if (const auto number = ParsePlainNumber(token)) {
+      return *number;
+    }
+
+    const char* const token_end = token.data() + token.size();
+    // Integer parsing stops at a fraction or an exponent;
+    // such tokens and integers out of int range are read as doubles
+    int int_value;
+    if (const auto [ptr, ec] = from_chars(token.data(), token_end, int_value); ec == errc() && ptr == token_end) {
+      return int_value;
+    }
+    double double_value;
+    if (const auto [ptr, ec] = from_chars(token.data(), token_end, double_value); ec == errc() && ptr == token_end) {
+      return double_value;
+    }
+    throw ParsingError("invalid number " + string(token));
+  }
+
+  static void AppendUtf8(uint32_t code_point, string& output) {
+    if (code_point < 0x80) {
+      output.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      output.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      output.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      output.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      output.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  void Scanner::SkipSpaces() {
+    while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+      ++pos_;
+    }
+  }
+
+  char Scanner::PeekToken() {
+    SkipSpaces();
+    if (pos_ == end_) {
+      throw ParsingError("unexpected end of input");
+    }
+    return *pos_;
+  }
+
+  bool Scanner::AtEnd() {
+    SkipSpaces();
+    return pos_ == end_;
+  }
+
+  void Scanner::Expect(char c) {
+    if (PeekToken() != c) {
+      throw ParsingError("expected '"s + c + "'");
+    }
+    ++pos_;
+  }
+
+  bool Scanner::Accept(char c) {
+    if (PeekToken() != c) {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  bool Scanner::ScanBool() {
+    PeekToken();
+    for (const string_view literal : {"true"sv, "false"sv}) {
+      if (static_cast<size_t>(end_ - pos_) >= literal.size() && string_view(pos_, literal.size()) == literal) {
+        pos_ += literal.size();
+        return literal == "true"sv;
+      }
+    }
+    throw ParsingError("invalid literal");
+  }
+
+  variant<int, double> Scanner::ScanNumber() {
+    PeekToken();
+    const char* token_begin = pos_;
+    while (pos_ != end_ && IsNumberChar(*pos_)) {
+      ++pos_;
+    }
+    return ParseNumber(string_view(token_begin, pos_ - token_begin));
+  }
+
+  string_view Scanner::ScanString(string& buffer) {
+    Expect('"');
+    const char* chunk_begin = pos_;
+    bool has_escapes = false;
+    while (true) {
+      while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\') {
+        ++pos_;
+      }
+      if (pos_ == end_) {
+        throw ParsingError("unterminated string");
+      }
+      if (*pos_ == '"' && !has_escapes) {
+        return string_view(chunk_begin, pos_++ - chunk_begin);
+      }
+      if (!has_escapes) {
+        buffer.clear();
+        has_escapes = true;
+      }
+      buffer.append(chunk_begin, pos_);
+      if (*pos_++ == '"') {
+        return buffer;
+      }
+      ScanEscape(buffer);
+      chunk_begin = pos_;
+    }
+  }
+
+  void Scanner::ScanEscape(string& output) {
+    if (pos_ == end_) {
+      throw ParsingError("unterminated string");
+    }
+    switch (const char c = *pos_++) {
+      case '"':
+      case '\\':
+      case '/':
+        output.push_back(c);
+        break;
+      case 'b':
+        output.push_back('\b');
+        break;
+      case 'f':
+        output.push_back('\f');
+        break;
+      case 'n':
+        output.push_back('\n');
+        break;
+      case 'r':
+        output.push_back('\r');
+        break;
+      case 't':
+        output.push_back('\t');
+        break;
+      case 'u':
+        AppendUtf8(ScanCodePoint(), output);
+        break;
+      default:
+        throw ParsingError("invalid escape sequence");
+    }
+  }
+
+  uint32_t Scanner::ScanHexQuad() {
+    if (end_ - pos_ < 4) {
+      throw ParsingError("invalid unicode escape");
+    }
+    uint32_t value = 0;
+    for (const char* quad_end = pos_ + 4; pos_ != quad_end; ++pos_) {
+      value <<= 4;
+      if (IsDigit(*pos_)) {
+        value |= *pos_ - '0';
+      } else if (const char c = *pos_ | 0x20; c >= 'a' && c <= 'f') {  // lower case
+        value |= c - 'a' + 10;
+      } else {
+        throw ParsingError("invalid unicode escape");
+      }
+    }
+    return value;
+  }
+
+  // Called after "\u"; joins surrogate pairs
+  uint32_t Scanner::ScanCodePoint() {
+    const uint32_t code_point = ScanHexQuad();
+    if (code_point < 0xD800 || code_point > 0xDBFF) {
+      return code_point;
+    }
+    if (end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+      throw ParsingError("unpaired surrogate");
+    }
+    pos_ += 2;
+    const uint32_t low_surrogate = ScanHexQuad();
+    if (low_surrogate < 0xDC00 || low_surrogate > 0xDFFF) {
+      throw ParsingError("unpaired surrogate");
+    }
+    return 0x10000 + ((code_point - 0xD800) << 10) + (low_surrogate - 0xDC00);
+  }
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace Json {
+
+  // Characters a number token may consist of
+  bool IsNumberChar(char c);
+
+  // Parses a whole number token with from_chars: int if it has neither fraction nor exponent
+  // and fits into int, double otherwise. Throws ParsingError on malformed tokens.
+  std::variant<int, double> ParseNumber(std::string_view token);
+
+  // Tokenizer over a contiguous buffer shared by the buffer-based parsers.
+  // Throws ParsingError on malformed input.
+  class Scanner {
+  public:
+    explicit Scanner(std::string_view input) : pos_(input.data()), end_(input.data() + input.size()) {}
+
+    // Next non-space character; throws at the end of input
+    char PeekToken();
+    // Only spaces are left
+    bool AtEnd();
+
+    void Expect(char c);
+    // Consumes c if it is the next token
+    bool Accept(char c);
+
+    bool ScanBool();
+    std::variant<int, double> ScanNumber();
+    // Returns the contents of a string token: a view into the input if it has no escapes,
+    // otherwise a view into buffer, which receives the unescaped string
+    std::string_view ScanString(std::string& buffer);
+
+  private:
+    const char* pos_;
+    const char* const end_;
+
+    void SkipSpaces();
+    void ScanEscape(std::string& output);
+    uint32_t ScanHexQuad();
+    uint32_t ScanCodePoint();
+  };
+
+}
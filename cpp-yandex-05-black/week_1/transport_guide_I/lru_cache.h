@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+struct LruCacheStats {
+  size_t hit_count = 0;
+  size_t miss_count = 0;
+};
+
+// Thread-safe cache of immutable shared values that evicts the least recently used one
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+public:
+  using ValuePtr = std::shared_ptr<const Value>;
+
+  explicit LruCache(size_t max_size) : max_size_(max_size) {}
+
+  // Returns the cached value for the key or caches the one returned by compute_value().
+  // compute_value runs unlocked, so concurrent misses don't wait for each other.
+  template <typename ComputeValue>
+  ValuePtr GetOrCompute(const Key& key, ComputeValue compute_value);
+
+  LruCacheStats GetStats() const;
+
+  size_t GetMaxSize() const {
+    return max_size_;
+  }
+
+private:
+  using Item = std::pair<Key, ValuePtr>;
+
+  const size_t max_size_;
+
+  mutable std::mutex mutex_;
+  std::list<Item> items_;  // most recently used first
+  std::unordered_map<Key, typename std::list<Item>::iterator, Hash> item_positions_;
+  LruCacheStats stats_;
+};
+
+
+template <typename Key, typename Value, typename Hash>
+template <typename ComputeValue>
+typename LruCache<Key, Value, Hash>::ValuePtr
+LruCache<Key, Value, Hash>::GetOrCompute(const Key& key, ComputeValue compute_value) {
+  if (max_size_ == 0) {
+    return compute_value();
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    if (auto it = item_positions_.find(key); it != item_positions_.end()) {
+      ++stats_.hit_count;
+      items_.splice(items_.begin(), items_, it->second);
+      return it->second->second;
+    }
+    ++stats_.miss_count;
+  }
+
+  ValuePtr value = compute_value();
+
+  std::lock_guard lock(mutex_);
+  if (item_positions_.count(key) > 0) {
+    return value;  // computed by another thread in the meantime
+  }
+  items_.emplace_front(key, value);
+  item_positions_[key] = items_.begin();
+  if (items_.size() > max_size_) {
+    item_positions_.erase(items_.back().first);
+    items_.pop_back();
+  }
+  return value;
+}
+
+template <typename Key, typename Value, typename Hash>
+LruCacheStats LruCache<Key, Value, Hash>::GetStats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
@@ -1,29 +1,86 @@
 #include "descriptions.h"
 #include "json.h"
+#include "lru_cache.h"
 #include "requests.h"
+#include "snapshot.h"
 #include "sphere.h"
 #include "transport_catalog.h"
 #include "utils.h"
 
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
 
 using namespace std;
 
-int main() {
-  const auto input_doc = Json::Load(cin);
-  const auto& input_map = input_doc.GetRoot().AsMap();
+static const string& GetSnapshotPath(const Json::Dict& input_map) {
+  return input_map.at("serialization_settings").AsMap().at("file").AsString();
+}
+
+static void WriteResponses(const TransportCatalog& db, const Json::Dict& input_map, bool print_cache_stats) {
+  Requests::WriteAll(db, input_map.at("stat_requests").AsArray(), cout, thread::hardware_concurrency());
+  cout << endl;
+  if (print_cache_stats) {
+    const LruCacheStats route_cache_stats = db.GetRouteCacheStats();
+    cerr << "route cache: " << route_cache_stats.hit_count << " hits, "
+         << route_cache_stats.miss_count << " misses" << endl;
+    const LruCacheStats tile_cache_stats = db.GetTileCacheStats();
+    cerr << "tile cache: " << tile_cache_stats.hit_count << " hits, "
+         << tile_cache_stats.miss_count << " misses" << endl;
+  }
+}
+
+// With no arguments the catalog is built and queried in one run.
+// make_base builds it and saves a snapshot to serialization_settings.file,
+// process_requests answers stat_requests with the catalog loaded from that snapshot.
+// --cache-stats prints the hit and miss counts of the caches to stderr once the requests are answered.
+int main(int argc, const char* argv[]) {
+  string_view mode;
+  bool print_cache_stats = false;
+  for (int arg_idx = 1; arg_idx < argc; ++arg_idx) {
+    const string_view arg = argv[arg_idx];
+    if (arg == "--cache-stats") {
+      print_cache_stats = true;
+    } else if (mode.empty() && (arg == "make_base" || arg == "process_requests")) {
+      mode = arg;
+    } else {
+      cerr << "Usage: transport_guide_I [make_base|process_requests] [--cache-stats]" << endl;
+      return 1;
+    }
+  }
+
+  // The whole input is read at once for the buffer parser, which is much faster than the stream one
+  const string input{istreambuf_iterator<char>(cin), istreambuf_iterator<char>()};
+
+  // Base requests go straight into queries, a tree is built only for the rest of the input
+  Descriptions::QueriesReader queries_reader;
+  Json::NodeBuilder input_builder({{"base_requests", &queries_reader}});
+  Json::Read(input, input_builder);
+  const Json::Node input_root = input_builder.ExtractRoot();
+  const auto& input_map = input_root.AsMap();
+
+  if (mode == "process_requests") {
+    const TransportCatalog db(make_unique<Snapshot::Reader>(GetSnapshotPath(input_map)));
+    WriteResponses(db, input_map, print_cache_stats);
+    return 0;
+  }
 
   const TransportCatalog db(
-      Descriptions::ReadDescriptions(input_map.at("base_requests").AsArray()),
+      queries_reader.ExtractQueries(),
       input_map.at("routing_settings").AsMap(),
       input_map.at("render_settings").AsMap()
   );
 
-  Json::PrintValue(
-    Requests::ProcessAll(db, input_map.at("stat_requests").AsArray()),
-    cout
-  );
-  cout << endl;
+  if (mode == "make_base") {
+    Snapshot::Writer snapshot_writer;
+    db.Serialize(snapshot_writer);
+    snapshot_writer.Save(GetSnapshotPath(input_map));
+  } else {
+    WriteResponses(db, input_map, print_cache_stats);
+  }
 
   return 0;
 }
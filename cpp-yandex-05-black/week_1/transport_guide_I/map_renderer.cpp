@@ -2,7 +2,13 @@
 #include "sphere.h"
 #include "sphere_projection.h"
 #include "utils.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <string_view>
 
 using namespace std;
 
@@ -65,8 +71,101 @@ RenderSettings ParseRenderSettings(const Json::Dict& json) {
   return result;
 }
 
-static map<string, Svg::Point> ComputeStopsCoords(const Descriptions::StopsDict& stops_dict,
-                                                  const RenderSettings& render_settings) {
+// Numbers as doubles and ints, colors as their alternative indices, strings, rgb components and opacities,
+// the ones of other alternatives left empty. Rgba is written field by field, having padding.
+static void SerializeRenderSettings(const RenderSettings& settings, Snapshot::Writer& writer) {
+  writer.WriteArray(vector<double>{
+      settings.max_width, settings.max_height, settings.padding,
+      settings.line_width, settings.underlayer_width, settings.stop_radius,
+      settings.bus_label_offset.x, settings.bus_label_offset.y,
+      settings.stop_label_offset.x, settings.stop_label_offset.y,
+  });
+  writer.WriteArray(vector<int>{settings.bus_label_font_size, settings.stop_label_font_size});
+
+  vector<Svg::Color> colors = settings.palette;
+  colors.push_back(settings.underlayer_color);
+  vector<uint8_t> color_kinds;
+  vector<string> color_names;
+  vector<uint8_t> color_components;
+  vector<double> color_opacities;
+  for (const Svg::Color& color : colors) {
+    color_kinds.push_back(color.index());
+    color_names.push_back(holds_alternative<string>(color) ? get<string>(color) : "");
+    Svg::Rgba rgba{};
+    if (const auto* rgb = get_if<Svg::Rgb>(&color)) {
+      rgba = {*rgb, 1.0};
+    } else if (const auto* color_rgba = get_if<Svg::Rgba>(&color)) {
+      rgba = *color_rgba;
+    }
+    color_components.insert(end(color_components), {rgba.red, rgba.green, rgba.blue});
+    color_opacities.push_back(rgba.opacity);
+  }
+  writer.WriteArray(color_kinds);
+  writer.WriteStrings(color_names);
+  writer.WriteArray(color_components);
+  writer.WriteArray(color_opacities);
+
+  writer.WriteStrings(settings.layers);
+}
+
+static RenderSettings LoadRenderSettings(Snapshot::Reader& reader) {
+  const auto numbers = reader.ReadVector<double>();
+  const auto font_sizes = reader.ReadVector<int>();
+  const auto color_kinds = reader.ReadVector<uint8_t>();
+  const auto color_names = reader.ReadStrings();
+  const auto color_components = reader.ReadVector<uint8_t>();
+  const auto color_opacities = reader.ReadVector<double>();
+  if (numbers.size() != 10 || font_sizes.size() != 2 || color_kinds.empty()
+      || color_names.size() != color_kinds.size() || color_components.size() != 3 * color_kinds.size()
+      || color_opacities.size() != color_kinds.size()) {
+    throw Snapshot::FormatError("malformed render settings");
+  }
+
+  vector<Svg::Color> colors;
+  for (size_t color_idx = 0; color_idx < color_kinds.size(); ++color_idx) {
+    const Svg::Rgb rgb{
+        color_components[3 * color_idx],
+        color_components[3 * color_idx + 1],
+        color_components[3 * color_idx + 2],
+    };
+    switch (color_kinds[color_idx]) {
+      case 0:
+        colors.push_back(Svg::NoneColor);
+        break;
+      case 1:
+        colors.push_back(color_names[color_idx]);
+        break;
+      case 2:
+        colors.push_back(rgb);
+        break;
+      case 3:
+        colors.push_back(Svg::Rgba{rgb, color_opacities[color_idx]});
+        break;
+      default:
+        throw Snapshot::FormatError("unknown color");
+    }
+  }
+
+  RenderSettings settings{
+      .max_width = numbers[0],
+      .max_height = numbers[1],
+      .padding = numbers[2],
+      .palette = {begin(colors), prev(end(colors))},
+      .line_width = numbers[3],
+      .underlayer_color = colors.back(),
+      .underlayer_width = numbers[4],
+      .stop_radius = numbers[5],
+      .bus_label_offset = {numbers[6], numbers[7]},
+      .bus_label_font_size = font_sizes[0],
+      .stop_label_offset = {numbers[8], numbers[9]},
+      .stop_label_font_size = font_sizes[1],
+      .layers = reader.ReadStrings(),
+  };
+  return settings;
+}
+
+static vector<Svg::Point> ComputeStopPoints(const Descriptions::StopsDict& stops_dict,
+                                            const RenderSettings& render_settings) {
   vector<Sphere::Point> points;
   points.reserve(stops_dict.size());
   for (const auto& [_, stop_ptr] : stops_dict) {
@@ -82,59 +181,133 @@ static map<string, Svg::Point> ComputeStopsCoords(const Descriptions::StopsDict&
       max_width, max_height, padding
   );
 
-  map<string, Svg::Point> stops_coords;
-  for (const auto& [stop_name, stop_ptr] : stops_dict) {
-    stops_coords[stop_name] = projector(stop_ptr->position);
+  vector<Svg::Point> stop_points;
+  stop_points.reserve(points.size());
+  for (const Sphere::Point point : points) {
+    stop_points.push_back(projector(point));
   }
 
-  return stops_coords;
+  return stop_points;
 }
 
-static unordered_map<string, Svg::Color> ChooseBusColors(const Descriptions::BusesDict& buses_dict,
-                                                         const RenderSettings& render_settings) {
-  const auto& palette = render_settings.palette;
-  unordered_map<string, Svg::Color> bus_colors;
-  int idx = 0;
-  for (const auto& [bus_name, bus_ptr] : buses_dict) {
-    bus_colors[bus_name] = palette[idx++ % palette.size()];
+// Checks arrays of items of several groups: group i has items [offsets[i], offsets[i + 1])
+template <typename Item>
+static void CheckGroups(const Snapshot::Array<size_t>& offsets, const Snapshot::Array<Item>& items,
+                        size_t group_count, size_t item_limit) {
+  if (offsets.size() != group_count + 1 || offsets.front() != 0 || offsets.back() != items.size()
+      || !is_sorted(begin(offsets), end(offsets))
+      || any_of(begin(items), end(items), [item_limit](Item item) { return item >= item_limit; })) {
+    throw Snapshot::FormatError("malformed map groups");
   }
-  return bus_colors;
 }
 
 MapRenderer::MapRenderer(const Descriptions::StopsDict& stops_dict,
                          const Descriptions::BusesDict& buses_dict,
                          const Json::Dict& render_settings_json)
     : render_settings_(ParseRenderSettings(render_settings_json)),
-      buses_dict_(buses_dict),
-      stops_coords_(ComputeStopsCoords(stops_dict, render_settings_)),
-      bus_colors_(ChooseBusColors(buses_dict, render_settings_))
+      stop_points_(ComputeStopPoints(stops_dict, render_settings_))
 {
+  unordered_map<string_view, Idx> stop_idxs;
+  stop_names_.reserve(stops_dict.size());
+  stop_idxs.reserve(stops_dict.size());
+  for (const auto& [stop_name, _] : stops_dict) {
+    stop_idxs.emplace(stop_name, stop_names_.size());
+    stop_names_.push_back(stop_name);
+  }
+
+  auto& bus_stops_offsets = bus_stops_offsets_.Edit();
+  auto& bus_stops = bus_stops_.Edit();
+  auto& bus_endpoints_offsets = bus_endpoints_offsets_.Edit();
+  auto& bus_endpoints = bus_endpoints_.Edit();
+  bus_names_.reserve(buses_dict.size());
+  bus_stops_offsets.push_back(0);
+  bus_endpoints_offsets.push_back(0);
+  for (const auto& [bus_name, bus_ptr] : buses_dict) {
+    bus_names_.push_back(bus_name);
+    for (const string& stop_name : bus_ptr->stops) {
+      bus_stops.push_back(stop_idxs.at(stop_name));
+    }
+    bus_stops_offsets.push_back(bus_stops.size());
+    for (const string& stop_name : bus_ptr->endpoints) {
+      bus_endpoints.push_back(stop_idxs.at(stop_name));
+    }
+    bus_endpoints_offsets.push_back(bus_endpoints.size());
+  }
+
+  grid_ = BuildGrid();
+}
+
+MapRenderer::MapRenderer(Snapshot::Reader& reader)
+    : render_settings_(LoadRenderSettings(reader)),
+      stop_names_(reader.ReadStrings()),
+      stop_points_(reader.ReadMappedArray<Svg::Point>()),
+      bus_names_(reader.ReadStrings()),
+      bus_stops_offsets_(reader.ReadMappedArray<size_t>()),
+      bus_stops_(reader.ReadMappedArray<Idx>()),
+      bus_endpoints_offsets_(reader.ReadMappedArray<size_t>()),
+      bus_endpoints_(reader.ReadMappedArray<Idx>())
+{
+  if (stop_points_.size() != stop_names_.size()) {
+    throw Snapshot::FormatError("malformed map stops");
+  }
+  CheckGroups(bus_stops_offsets_, bus_stops_, bus_names_.size(), stop_names_.size());
+  CheckGroups(bus_endpoints_offsets_, bus_endpoints_, bus_names_.size(), stop_names_.size());
+  for (const string& layer : render_settings_.layers) {
+    if (LAYER_ACTIONS.count(layer) == 0) {
+      throw Snapshot::FormatError("unknown layer " + layer);
+    }
+  }
+  grid_ = BuildGrid();
+}
+
+void MapRenderer::Serialize(Snapshot::Writer& writer) const {
+  SerializeRenderSettings(render_settings_, writer);
+  writer.WriteStrings(stop_names_);
+  writer.WriteArray(stop_points_);
+  writer.WriteStrings(bus_names_);
+  writer.WriteArray(bus_stops_offsets_);
+  writer.WriteArray(bus_stops_);
+  writer.WriteArray(bus_endpoints_offsets_);
+  writer.WriteArray(bus_endpoints_);
+}
+
+Range<const MapRenderer::Idx*> MapRenderer::GetBusStops(Idx bus_idx) const {
+  return {begin(bus_stops_) + bus_stops_offsets_[bus_idx], begin(bus_stops_) + bus_stops_offsets_[bus_idx + 1]};
+}
+
+Range<const MapRenderer::Idx*> MapRenderer::GetBusEndpoints(Idx bus_idx) const {
+  return {begin(bus_endpoints_) + bus_endpoints_offsets_[bus_idx],
+          begin(bus_endpoints_) + bus_endpoints_offsets_[bus_idx + 1]};
+}
+
+const Svg::Color& MapRenderer::GetBusColor(Idx bus_idx) const {
+  const auto& palette = render_settings_.palette;
+  return palette[bus_idx % palette.size()];
 }
 
-void MapRenderer::RenderBusLines(Svg::Document& svg) const {
-  for (const auto& [bus_name, bus_ptr] : buses_dict_) {
-    const auto& stops = bus_ptr->stops;
-    if (stops.empty()) {
+void MapRenderer::RenderBusLines(Svg::Document& svg, const Selection& selection) const {
+  for (const Idx bus_idx : selection.bus_idxs) {
+    const auto stops = GetBusStops(bus_idx);
+    if (stops.size() == 0) {
       continue;
     }
     Svg::Polyline line;
-    line.SetStrokeColor(bus_colors_.at(bus_name))
+    line.SetStrokeColor(GetBusColor(bus_idx))
         .SetStrokeWidth(render_settings_.line_width)
         .SetStrokeLineCap("round").SetStrokeLineJoin("round");
-    for (const auto& stop_name : stops) {
-      line.AddPoint(stops_coords_.at(stop_name));
+    for (const Idx stop_idx : stops) {
+      line.AddPoint(stop_points_[stop_idx]);
     }
     svg.Add(line);
   }
 }
 
-void MapRenderer::RenderBusLabels(Svg::Document& svg) const {
-  for (const auto& [bus_name, bus_ptr] : buses_dict_) {
-    const auto& stops = bus_ptr->stops;
-    if (!stops.empty()) {
-      const auto& color = bus_colors_.at(bus_name);
-      for (const string& endpoint : bus_ptr->endpoints) {
-        const auto point = stops_coords_.at(endpoint);
+void MapRenderer::RenderBusLabels(Svg::Document& svg, const Selection& selection) const {
+  for (const Idx bus_idx : selection.bus_label_idxs) {
+    if (GetBusStops(bus_idx).size() != 0) {
+      const auto& color = GetBusColor(bus_idx);
+      for (const Idx endpoint_idx : GetBusEndpoints(bus_idx)) {
+        const auto point = stop_points_[endpoint_idx];
         const auto base_text =
             Svg::Text{}
             .SetPoint(point)
@@ -142,7 +315,7 @@ void MapRenderer::RenderBusLabels(Svg::Document& svg) const {
             .SetFontSize(render_settings_.bus_label_font_size)
             .SetFontFamily("Verdana")
             .SetFontWeight("bold")
-            .SetData(bus_name);
+            .SetData(bus_names_[bus_idx]);
         svg.Add(
             Svg::Text(base_text)
             .SetFillColor(render_settings_.underlayer_color)
@@ -159,24 +332,24 @@ void MapRenderer::RenderBusLabels(Svg::Document& svg) const {
   }
 }
 
-void MapRenderer::RenderStopPoints(Svg::Document& svg) const {
-  for (const auto& [stop_name, stop_point] : stops_coords_) {
+void MapRenderer::RenderStopPoints(Svg::Document& svg, const Selection& selection) const {
+  for (const Idx stop_idx : selection.stop_idxs) {
     svg.Add(Svg::Circle{}
-            .SetCenter(stop_point)
+            .SetCenter(stop_points_[stop_idx])
             .SetRadius(render_settings_.stop_radius)
             .SetFillColor("white"));
   }
 }
 
-void MapRenderer::RenderStopLabels(Svg::Document& svg) const {
-  for (const auto& [stop_name, stop_point] : stops_coords_) {
+void MapRenderer::RenderStopLabels(Svg::Document& svg, const Selection& selection) const {
+  for (const Idx stop_idx : selection.stop_label_idxs) {
     const auto base_text =
         Svg::Text{}
-        .SetPoint(stop_point)
+        .SetPoint(stop_points_[stop_idx])
         .SetOffset(render_settings_.stop_label_offset)
         .SetFontSize(render_settings_.stop_label_font_size)
         .SetFontFamily("Verdana")
-        .SetData(stop_name);
+        .SetData(stop_names_[stop_idx]);
     svg.Add(
         Svg::Text(base_text)
         .SetFillColor(render_settings_.underlayer_color)
@@ -191,19 +364,333 @@ void MapRenderer::RenderStopLabels(Svg::Document& svg) const {
   }
 }
 
-const unordered_map<string, void (MapRenderer::*)(Svg::Document&) const> MapRenderer::LAYER_ACTIONS = {
+const unordered_map<string, MapRenderer::LayerAction> MapRenderer::LAYER_ACTIONS = {
     {"bus_lines",   &MapRenderer::RenderBusLines},
     {"bus_labels",  &MapRenderer::RenderBusLabels},
     {"stop_points", &MapRenderer::RenderStopPoints},
     {"stop_labels", &MapRenderer::RenderStopLabels},
 };
 
-Svg::Document MapRenderer::Render() const {
-  Svg::Document svg;
-
+void MapRenderer::RenderLayers(Svg::Document& svg, const Selection& selection) const {
   for (const auto& layer : render_settings_.layers) {
-    (this->*LAYER_ACTIONS.at(layer))(svg);
+    (this->*LAYER_ACTIONS.at(layer))(svg, selection);
+  }
+}
+
+// Indices of the part_idx-th of part_count contiguous parts of [0, count)
+template <typename Idx>
+static vector<Idx> MakePartIndices(size_t count, size_t part_idx, size_t part_count) {
+  const size_t part_size = (count + part_count - 1) / part_count;
+  const size_t part_begin = min(count, part_idx * part_size);
+  const size_t part_end = min(count, part_begin + part_size);
+  vector<Idx> indices(part_end - part_begin);
+  iota(begin(indices), end(indices), part_begin);
+  return indices;
+}
+
+vector<Svg::Document> MapRenderer::Render(size_t thread_count) const {
+  thread_count = max<size_t>(1, thread_count);
+  const auto& layers = render_settings_.layers;
+  vector<Svg::Document> parts(layers.size() * thread_count);
+
+  ParallelFor(thread_count, [&](size_t part_idx) {
+    Selection selection{
+        .bus_idxs = MakePartIndices<Idx>(bus_names_.size(), part_idx, thread_count),
+        .stop_idxs = MakePartIndices<Idx>(stop_names_.size(), part_idx, thread_count),
+    };
+    selection.bus_label_idxs = selection.bus_idxs;
+    selection.stop_label_idxs = selection.stop_idxs;
+    for (size_t layer_idx = 0; layer_idx < layers.size(); ++layer_idx) {
+      (this->*LAYER_ACTIONS.at(layers[layer_idx]))(parts[layer_idx * thread_count + part_idx], selection);
+    }
+  }, thread_count);
+
+  return parts;
+}
+
+// Groups values by cells, keeping their order within a cell
+template <typename Value>
+static void GroupByCells(const vector<pair<size_t, Value>>& entries, size_t cell_count,
+                         vector<size_t>& offsets, vector<Value>& values) {
+  offsets.assign(cell_count + 1, 0);
+  for (const auto& [cell, _] : entries) {
+    ++offsets[cell + 1];
+  }
+  partial_sum(begin(offsets), end(offsets), begin(offsets));
+  values.resize(entries.size());
+  vector<size_t> next_positions(begin(offsets), prev(end(offsets)));
+  for (const auto& [cell, value] : entries) {
+    values[next_positions[cell]++] = value;
+  }
+}
+
+size_t MapRenderer::Grid::GetColumn(double x) const {
+  const double column = floor((x - min.x) / cell_size);
+  return static_cast<size_t>(clamp(column, 0.0, column_count - 1.0));
+}
+
+size_t MapRenderer::Grid::GetRow(double y) const {
+  const double row = floor((y - min.y) / cell_size);
+  return static_cast<size_t>(clamp(row, 0.0, row_count - 1.0));
+}
+
+// Range of x of the segment points with min_y <= y <= max_y, or the whole segment if it is horizontal
+static pair<double, double> ClipSegmentToBand(Svg::Point from, Svg::Point to, double min_y, double max_y) {
+  const double dy = to.y - from.y;
+  if (dy == 0) {
+    return minmax({from.x, to.x});
+  }
+  const auto [t_begin, t_end] = minmax({(min_y - from.y) / dy, (max_y - from.y) / dy});
+  const double x_begin = from.x + clamp(t_begin, 0.0, 1.0) * (to.x - from.x);
+  const double x_end = from.x + clamp(t_end, 0.0, 1.0) * (to.x - from.x);
+  return minmax({x_begin, x_end});
+}
+
+MapRenderer::Grid MapRenderer::BuildGrid() const {
+  static constexpr double STOPS_PER_CELL = 4;  // for evenly spread stops
+
+  Grid grid;
+  if (stop_points_.empty()) {
+    return grid;
+  }
+  const auto [min_x_it, max_x_it] = minmax_element(begin(stop_points_), end(stop_points_),
+                                                   [](Svg::Point lhs, Svg::Point rhs) { return lhs.x < rhs.x; });
+  const auto [min_y_it, max_y_it] = minmax_element(begin(stop_points_), end(stop_points_),
+                                                   [](Svg::Point lhs, Svg::Point rhs) { return lhs.y < rhs.y; });
+  grid.min = {min_x_it->x, min_y_it->y};
+  const double width = max_x_it->x - min_x_it->x;
+  const double height = max_y_it->y - min_y_it->y;
+  const double side_cell_count = max(1.0, floor(sqrt(stop_points_.size() / STOPS_PER_CELL)));
+  if (max(width, height) > 0) {
+    grid.cell_size = max(width, height) / side_cell_count;
+  }
+  grid.column_count = static_cast<size_t>(width / grid.cell_size) + 1;
+  grid.row_count = static_cast<size_t>(height / grid.cell_size) + 1;
+  const size_t cell_count = grid.column_count * grid.row_count;
+
+  vector<pair<size_t, Idx>> stop_entries;
+  stop_entries.reserve(stop_points_.size());
+  for (Idx stop_idx = 0; stop_idx < stop_points_.size(); ++stop_idx) {
+    const Svg::Point point = stop_points_[stop_idx];
+    stop_entries.emplace_back(grid.GetRow(point.y) * grid.column_count + grid.GetColumn(point.x), stop_idx);
   }
+  GroupByCells(stop_entries, cell_count, grid.stops_offsets, grid.stops);
 
+  // Segments of a bus often share cells, each cell gets the bus once
+  vector<pair<size_t, Idx>> bus_entries;
+  vector<Idx> cell_last_buses(cell_count, numeric_limits<Idx>::max());
+  for (Idx bus_idx = 0; bus_idx < bus_names_.size(); ++bus_idx) {
+    const auto stops = GetBusStops(bus_idx);
+    if (stops.size() == 0) {
+      continue;
+    }
+    // Segments between consecutive stops, or the only stop of the bus as a segment to itself
+    const size_t segment_count = max<size_t>(stops.size() - 1, 1);
+    for (size_t segment_idx = 0; segment_idx < segment_count; ++segment_idx) {
+      const Svg::Point from = stop_points_[stops.begin()[segment_idx]];
+      const Svg::Point to = stop_points_[stops.begin()[min(segment_idx + 1, stops.size() - 1)]];
+      for (size_t row = grid.GetRow(min(from.y, to.y)); row <= grid.GetRow(max(from.y, to.y)); ++row) {
+        // Columns of the part of the segment in the row, widened a bit against rounding
+        const auto [part_min_x, part_max_x] = ClipSegmentToBand(from, to, grid.min.y + row * grid.cell_size,
+                                                                grid.min.y + (row + 1) * grid.cell_size);
+        const double rounding_margin = grid.cell_size * 1e-9;
+        const size_t first_column = grid.GetColumn(part_min_x - rounding_margin);
+        const size_t last_column = grid.GetColumn(part_max_x + rounding_margin);
+        for (size_t column = first_column; column <= last_column; ++column) {
+          const size_t cell = row * grid.column_count + column;
+          if (cell_last_buses[cell] != bus_idx) {
+            cell_last_buses[cell] = bus_idx;
+            bus_entries.emplace_back(cell, bus_idx);
+          }
+        }
+      }
+    }
+  }
+  GroupByCells(bus_entries, cell_count, grid.buses_offsets, grid.buses);
+
+  for (const string& stop_name : stop_names_) {
+    grid.max_stop_name_size = max(grid.max_stop_name_size, stop_name.size());
+  }
+  for (const string& bus_name : bus_names_) {
+    grid.max_bus_name_size = max(grid.max_bus_name_size, bus_name.size());
+  }
+
+  return grid;
+}
+
+static bool IsInside(Svg::Point point, Svg::Point min, Svg::Point max) {
+  return min.x <= point.x && point.x <= max.x && min.y <= point.y && point.y <= max.y;
+}
+
+// Whether the segment has points in the box: the part of it on the inner side of every box side is not empty
+static bool DoesSegmentCrossBox(Svg::Point from, Svg::Point to, Svg::Point min, Svg::Point max) {
+  const double dx = to.x - from.x;
+  const double dy = to.y - from.y;
+  // The point from + t * (to - from) is on the inner side of a side if factor * t <= limit
+  const double factors[] = {-dx, dx, -dy, dy};
+  const double limits[] = {from.x - min.x, max.x - from.x, from.y - min.y, max.y - from.y};
+  double t_begin = 0;
+  double t_end = 1;
+  for (size_t side = 0; side < size(factors); ++side) {
+    if (factors[side] == 0) {
+      if (limits[side] < 0) {
+        return false;
+      }
+    } else if (factors[side] < 0) {
+      t_begin = std::max(t_begin, limits[side] / factors[side]);
+    } else {
+      t_end = std::min(t_end, limits[side] / factors[side]);
+    }
+    if (t_begin > t_end) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool DoBoxesIntersect(Svg::Point lhs_min, Svg::Point lhs_max, Svg::Point rhs_min, Svg::Point rhs_max) {
+  return lhs_min.x <= rhs_max.x && rhs_min.x <= lhs_max.x && lhs_min.y <= rhs_max.y && rhs_min.y <= lhs_max.y;
+}
+
+static Svg::Point Translate(Svg::Point point, Svg::Point offset) {
+  return {point.x + offset.x, point.y + offset.y};
+}
+
+// Box surely holding the text of a label anchored at the origin: a glyph is taken to be at most
+// a font size wide and to go at most a font size away from the baseline, there are at most
+// as many glyphs as bytes, and the underlayer stroke adds half its width around them
+static pair<Svg::Point, Svg::Point> ComputeLabelBounds(Svg::Point offset, int font_size, size_t text_size,
+                                                       double stroke_width) {
+  const double stroke_margin = stroke_width / 2;
+  return {
+      {offset.x - stroke_margin, offset.y - font_size - stroke_margin},
+      {offset.x + static_cast<double>(text_size) * font_size + stroke_margin, offset.y + font_size + stroke_margin},
+  };
+}
+
+vector<MapRenderer::Idx> MapRenderer::FindStopsNear(Svg::Point min, Svg::Point max) const {
+  vector<Idx> stop_idxs;
+  if (stop_points_.empty() || min.x > max.x || min.y > max.y) {
+    return stop_idxs;
+  }
+  for (size_t row = grid_.GetRow(min.y); row <= grid_.GetRow(max.y); ++row) {
+    for (size_t column = grid_.GetColumn(min.x); column <= grid_.GetColumn(max.x); ++column) {
+      const size_t cell = row * grid_.column_count + column;
+      stop_idxs.insert(end(stop_idxs), begin(grid_.stops) + grid_.stops_offsets[cell],
+                       begin(grid_.stops) + grid_.stops_offsets[cell + 1]);
+    }
+  }
+  return stop_idxs;
+}
+
+vector<MapRenderer::Idx> MapRenderer::FindBusesNear(Svg::Point min, Svg::Point max) const {
+  vector<Idx> bus_idxs;
+  if (stop_points_.empty() || min.x > max.x || min.y > max.y) {
+    return bus_idxs;
+  }
+  for (size_t row = grid_.GetRow(min.y); row <= grid_.GetRow(max.y); ++row) {
+    for (size_t column = grid_.GetColumn(min.x); column <= grid_.GetColumn(max.x); ++column) {
+      const size_t cell = row * grid_.column_count + column;
+      bus_idxs.insert(end(bus_idxs), begin(grid_.buses) + grid_.buses_offsets[cell],
+                      begin(grid_.buses) + grid_.buses_offsets[cell + 1]);
+    }
+  }
+  sort(begin(bus_idxs), end(bus_idxs));
+  bus_idxs.erase(unique(begin(bus_idxs), end(bus_idxs)), end(bus_idxs));
+  return bus_idxs;
+}
+
+MapRenderer::Selection MapRenderer::SelectShapes(const Svg::ViewBox& viewport) const {
+  const Svg::Point view_min = viewport.min;
+  const Svg::Point view_max{viewport.min.x + viewport.width, viewport.min.y + viewport.height};
+  Selection selection;
+
+  // Circles and lines crossing the border are seen partly, so nearby shapes are drawn too
+  const double margin = max(render_settings_.stop_radius, render_settings_.line_width / 2);
+  const Svg::Point min{view_min.x - margin, view_min.y - margin};
+  const Svg::Point max{view_max.x + margin, view_max.y + margin};
+
+  for (const Idx stop_idx : FindStopsNear(min, max)) {
+    if (IsInside(stop_points_[stop_idx], min, max)) {
+      selection.stop_idxs.push_back(stop_idx);
+    }
+  }
+  sort(begin(selection.stop_idxs), end(selection.stop_idxs));
+
+  selection.bus_idxs = FindBusesNear(min, max);
+  auto& bus_idxs = selection.bus_idxs;
+  bus_idxs.erase(remove_if(begin(bus_idxs), end(bus_idxs), [this, min, max](Idx bus_idx) {
+    const auto stops = GetBusStops(bus_idx);
+    if (stops.size() == 1) {
+      return !IsInside(stop_points_[*stops.begin()], min, max);
+    }
+    for (auto stop_it = stops.begin(); next(stop_it) != stops.end(); ++stop_it) {
+      if (DoesSegmentCrossBox(stop_points_[*stop_it], stop_points_[*next(stop_it)], min, max)) {
+        return false;
+      }
+    }
+    return true;
+  }), end(bus_idxs));
+
+  // Labels are drawn if the boxes of their texts meet the viewport. Candidates are the points
+  // near enough to the viewport for the longest label to reach it.
+  const double underlayer_width = render_settings_.underlayer_width;
+  const auto is_label_seen = [&](Svg::Point point, Svg::Point offset, int font_size, const string& text) {
+    const auto [label_min, label_max] = ComputeLabelBounds(offset, font_size, text.size(), underlayer_width);
+    return DoBoxesIntersect(Translate(point, label_min), Translate(point, label_max), view_min, view_max);
+  };
+
+  const Svg::Point stop_label_offset = render_settings_.stop_label_offset;
+  const int stop_label_font_size = render_settings_.stop_label_font_size;
+  const auto [stop_reach_min, stop_reach_max] =
+      ComputeLabelBounds(stop_label_offset, stop_label_font_size, grid_.max_stop_name_size, underlayer_width);
+  for (const Idx stop_idx : FindStopsNear({view_min.x - stop_reach_max.x, view_min.y - stop_reach_max.y},
+                                          {view_max.x - stop_reach_min.x, view_max.y - stop_reach_min.y})) {
+    if (is_label_seen(stop_points_[stop_idx], stop_label_offset, stop_label_font_size, stop_names_[stop_idx])) {
+      selection.stop_label_idxs.push_back(stop_idx);
+    }
+  }
+  sort(begin(selection.stop_label_idxs), end(selection.stop_label_idxs));
+
+  // Endpoints are on the routes, so the buses are listed in their cells
+  const Svg::Point bus_label_offset = render_settings_.bus_label_offset;
+  const int bus_label_font_size = render_settings_.bus_label_font_size;
+  const auto [bus_reach_min, bus_reach_max] =
+      ComputeLabelBounds(bus_label_offset, bus_label_font_size, grid_.max_bus_name_size, underlayer_width);
+  for (const Idx bus_idx : FindBusesNear({view_min.x - bus_reach_max.x, view_min.y - bus_reach_max.y},
+                                         {view_max.x - bus_reach_min.x, view_max.y - bus_reach_min.y})) {
+    const auto endpoints = GetBusEndpoints(bus_idx);
+    if (any_of(endpoints.begin(), endpoints.end(), [&](Idx stop_idx) {
+          return is_label_seen(stop_points_[stop_idx], bus_label_offset, bus_label_font_size, bus_names_[bus_idx]);
+        })) {
+      selection.bus_label_idxs.push_back(bus_idx);
+    }
+  }
+
+  return selection;
+}
+
+Svg::Document MapRenderer::RenderViewport(const Svg::ViewBox& viewport) const {
+  Svg::Document svg;
+  RenderLayers(svg, SelectShapes(viewport));
   return svg;
 }
+
+optional<Svg::ViewBox> MapRenderer::GetTileViewport(int zoom, int x, int y) const {
+  static constexpr int MAX_ZOOM = 30;
+
+  if (zoom < 0 || zoom > MAX_ZOOM) {
+    return nullopt;
+  }
+  const int side_tile_count = 1 << zoom;
+  if (x < 0 || x >= side_tile_count || y < 0 || y >= side_tile_count) {
+    return nullopt;
+  }
+  const double tile_width = render_settings_.max_width / side_tile_count;
+  const double tile_height = render_settings_.max_height / side_tile_count;
+  return Svg::ViewBox{
+      .min = {x * tile_width, y * tile_height},
+      .width = tile_width,
+      .height = tile_height,
+  };
+}
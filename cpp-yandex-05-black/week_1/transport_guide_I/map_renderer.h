@@ -2,9 +2,12 @@
 
 #include "descriptions.h"
 #include "json.h"
+#include "snapshot.h"
 #include "svg.h"
+#include "utils.h"
 
-#include <map>
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -31,19 +34,80 @@ public:
   MapRenderer(const Descriptions::StopsDict& stops_dict,
               const Descriptions::BusesDict& buses_dict,
               const Json::Dict& render_settings_json);
+  // Renderer written by Serialize, viewing its arrays in the mapping of the reader
+  explicit MapRenderer(Snapshot::Reader& reader);
 
-  Svg::Document Render() const;
+  void Serialize(Snapshot::Writer& writer) const;
+
+  // Parts of the map in drawing order. Every layer is split into thread_count parts
+  // by contiguous ranges of buses or stops, and thread i builds part i of each layer,
+  // so that the part of layer l built by thread i is parts[l * thread_count + i].
+  std::vector<Svg::Document> Render(size_t thread_count = 1) const;
+
+  // The shapes of the buses and stops that may be seen in the viewport, labels included, in drawing order
+  Svg::Document RenderViewport(const Svg::ViewBox& viewport) const;
+
+  // Viewport of tile (x, y) of the 2^zoom by 2^zoom grid over the picture, nullopt for tiles out of it
+  std::optional<Svg::ViewBox> GetTileViewport(int zoom, int x, int y) const;
 
 private:
+  // Stops and buses are numbered in name order
+  using Idx = uint32_t;
+
+  // Buses and stops to draw, ascending; labels are selected apart from lines and points
+  struct Selection {
+    std::vector<Idx> bus_idxs;
+    std::vector<Idx> stop_idxs;
+    std::vector<Idx> bus_label_idxs;
+    std::vector<Idx> stop_label_idxs;
+  };
+
+  // Uniform grid of square cells over the stop points. A cell lists the stops in it
+  // and the buses with segments crossing it, both ascending.
+  struct Grid {
+    Svg::Point min;
+    double cell_size = 1;
+    size_t column_count = 0;
+    size_t row_count = 0;
+    std::vector<size_t> stops_offsets;  // by cell, and one more
+    std::vector<Idx> stops;
+    std::vector<size_t> buses_offsets;
+    std::vector<Idx> buses;
+    // Longest names, which bound how far labels reach from their points
+    size_t max_stop_name_size = 0;
+    size_t max_bus_name_size = 0;
+
+    size_t GetColumn(double x) const;
+    size_t GetRow(double y) const;
+  };
+
   RenderSettings render_settings_;
-  const Descriptions::BusesDict& buses_dict_;
-  std::map<std::string, Svg::Point> stops_coords_;
-  std::unordered_map<std::string, Svg::Color> bus_colors_;
+  std::vector<std::string> stop_names_;
+  Snapshot::Array<Svg::Point> stop_points_;
+  std::vector<std::string> bus_names_;
+  // Stops of bus i are bus_stops_[bus_stops_offsets_[i], bus_stops_offsets_[i + 1]), endpoints likewise
+  Snapshot::Array<size_t> bus_stops_offsets_;
+  Snapshot::Array<Idx> bus_stops_;
+  Snapshot::Array<size_t> bus_endpoints_offsets_;
+  Snapshot::Array<Idx> bus_endpoints_;
+  Grid grid_;  // not serialized, built again on load
+
+  Range<const Idx*> GetBusStops(Idx bus_idx) const;
+  Range<const Idx*> GetBusEndpoints(Idx bus_idx) const;
+  const Svg::Color& GetBusColor(Idx bus_idx) const;
+
+  Grid BuildGrid() const;
+  // Stops in the cells overlapping the box, which may lie out of it, and buses listed there, ascending
+  std::vector<Idx> FindStopsNear(Svg::Point min, Svg::Point max) const;
+  std::vector<Idx> FindBusesNear(Svg::Point min, Svg::Point max) const;
+  Selection SelectShapes(const Svg::ViewBox& viewport) const;
+  void RenderLayers(Svg::Document& svg, const Selection& selection) const;
 
-  void RenderBusLines(Svg::Document& svg) const;
-  void RenderBusLabels(Svg::Document& svg) const;
-  void RenderStopPoints(Svg::Document& svg) const;
-  void RenderStopLabels(Svg::Document& svg) const;
+  void RenderBusLines(Svg::Document& svg, const Selection& selection) const;
+  void RenderBusLabels(Svg::Document& svg, const Selection& selection) const;
+  void RenderStopPoints(Svg::Document& svg, const Selection& selection) const;
+  void RenderStopLabels(Svg::Document& svg, const Selection& selection) const;
 
-  static const std::unordered_map<std::string, void (MapRenderer::*)(Svg::Document&) const> LAYER_ACTIONS;
+  using LayerAction = void (MapRenderer::*)(Svg::Document&, const Selection&) const;
+  static const std::unordered_map<std::string, LayerAction> LAYER_ACTIONS;
 };
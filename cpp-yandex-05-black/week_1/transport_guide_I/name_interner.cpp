@@ -0,0 +1,101 @@
+#include "name_interner.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+NameInterner::NameInterner(Snapshot::Reader& reader)
+    : offsets_(reader.ReadMappedArray<uint64_t>()),
+      chars_(reader.ReadMappedArray<char>()),
+      slots_(reader.ReadMappedArray<NameId>())
+{
+  const size_t slot_count = slots_.size();
+  // Increasing offsets ending at the chars size keep every name inside the chars
+  if (offsets_.empty() || offsets_[0] != 0 || offsets_.back() != chars_.size()
+      || !is_sorted(offsets_.begin(), offsets_.end())
+      || slot_count < 2 * size() || (slot_count & (slot_count - 1)) != 0) {
+    throw Snapshot::FormatError("malformed names");
+  }
+  // Every name must be in exactly one slot: lookups then read only known ids and stop at a free slot
+  vector<bool> is_slotted(size());
+  size_t slotted_count = 0;
+  for (const NameId id : slots_) {
+    if (id == NO_ID) {
+      continue;
+    }
+    if (id >= size() || is_slotted[id]) {
+      throw Snapshot::FormatError("malformed names");
+    }
+    is_slotted[id] = true;
+    ++slotted_count;
+  }
+  if (slotted_count != size()) {
+    throw Snapshot::FormatError("malformed names");
+  }
+}
+
+// FNV-1a: the table is saved in snapshots, so the hash must not depend on the standard library
+uint64_t NameInterner::ComputeHash(string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : name) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+size_t NameInterner::FindSlot(string_view name) const {
+  const size_t mask = slots_.size() - 1;
+  size_t slot = ComputeHash(name) & mask;
+  while (slots_[slot] != NO_ID && GetName(slots_[slot]) != name) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void NameInterner::Rehash(size_t slot_count) {
+  slots_ = vector<NameId>(slot_count, NO_ID);
+  for (NameId id = 0; id < size(); ++id) {
+    slots_.Edit()[FindSlot(GetName(id))] = id;
+  }
+}
+
+NameId NameInterner::Intern(string_view name) {
+  if (const auto id = Find(name)) {
+    return *id;
+  }
+  const NameId id = size();
+  auto& chars = chars_.Edit();
+  chars.insert(chars.end(), name.begin(), name.end());
+  offsets_.Edit().push_back(chars.size());
+  if (slots_.size() < 2 * size()) {
+    Rehash(max<size_t>(16, 2 * slots_.size()));
+  } else {
+    slots_.Edit()[FindSlot(name)] = id;
+  }
+  return id;
+}
+
+optional<NameId> NameInterner::Find(string_view name) const {
+  if (slots_.empty()) {
+    return nullopt;
+  }
+  if (const NameId id = slots_[FindSlot(name)]; id != NO_ID) {
+    return id;
+  }
+  return nullopt;
+}
+
+NameId NameInterner::GetId(string_view name) const {
+  if (const auto id = Find(name)) {
+    return *id;
+  }
+  throw out_of_range("unknown name " + string(name));
+}
+
+void NameInterner::Serialize(Snapshot::Writer& writer) const {
+  writer.WriteArray(offsets_);
+  writer.WriteArray(chars_);
+  writer.WriteArray(slots_);
+}
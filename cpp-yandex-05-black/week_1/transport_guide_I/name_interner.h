@@ -0,0 +1,53 @@
+#pragma once
+
+#include "snapshot.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using NameId = uint32_t;
+
+// Dense ids of names in order of their first appearance.
+// Names are kept as one array of chars with their offsets, and ids are found
+// in an open addressing table of them, so that a loaded interner views all of it in the snapshot.
+// Lookups take views and never allocate.
+class NameInterner {
+public:
+  NameInterner() = default;
+  // Names written by Serialize, with the same ids, viewed in the mapping of the reader
+  explicit NameInterner(Snapshot::Reader& reader);
+
+  NameId Intern(std::string_view name);
+
+  std::optional<NameId> Find(std::string_view name) const;
+  // Throws std::out_of_range for unknown names
+  NameId GetId(std::string_view name) const;
+
+  std::string_view GetName(NameId id) const {
+    return {chars_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]};
+  }
+
+  size_t size() const {
+    return offsets_.size() - 1;
+  }
+
+  void Serialize(Snapshot::Writer& writer) const;
+
+private:
+  static constexpr NameId NO_ID = std::numeric_limits<NameId>::max();
+
+  // Name i is chars_[offsets_[i], offsets_[i + 1])
+  Snapshot::Array<uint64_t> offsets_{std::vector<uint64_t>{0}};
+  Snapshot::Array<char> chars_;
+  // Ids by hashes of their names, linear probing. The size is a power of two
+  // at least twice the number of names, NO_ID marks free slots.
+  Snapshot::Array<NameId> slots_;
+
+  static uint64_t ComputeHash(std::string_view name);
+  // Slot of the name, or the free slot where it would be
+  size_t FindSlot(std::string_view name) const;
+  void Rehash(size_t slot_count);
+};
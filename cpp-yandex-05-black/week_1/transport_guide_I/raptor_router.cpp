@@ -0,0 +1,228 @@
+#include "raptor_router.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+using namespace std;
+
+static const double NO_TIME = numeric_limits<double>::infinity();
+
+RaptorRouter::RaptorRouter(const Descriptions::BusesDict& buses_dict,
+                           const Json::Dict& routing_settings_json,
+                           const NameInterner& stop_names,
+                           const NameInterner& bus_names,
+                           const vector<BusRoadRoute>& bus_routes)
+    : bus_wait_time_(routing_settings_json.at("bus_wait_time").AsInt()),
+      bus_velocity_(routing_settings_json.at("bus_velocity").AsDouble())
+{
+  auto& routes = bus_routes_.Edit();
+  auto& bus_name_ids = bus_name_ids_.Edit();
+  auto& route_stops = route_stops_.Edit();
+  auto& route_distances = route_distances_.Edit();
+  vector<size_t> stop_visit_counts(stop_names.size());
+  for (const auto& [bus_name, _] : buses_dict) {
+    const NameId bus_id = bus_names.GetId(bus_name);
+    const BusRoadRoute& route = bus_routes[bus_id];
+    if (route.stop_ids.size() <= 1) {
+      continue;
+    }
+    routes.push_back({route_stops.size(), route_stops.size() + route.stop_ids.size()});
+    bus_name_ids.push_back(bus_id);
+    route_stops.insert(end(route_stops), begin(route.stop_ids), end(route.stop_ids));
+    route_distances.insert(end(route_distances), begin(route.distances), end(route.distances));
+    for (const StopId stop_id : route.stop_ids) {
+      ++stop_visit_counts[stop_id];
+    }
+  }
+
+  auto& stop_visits_offsets = stop_visits_offsets_.Edit();
+  stop_visits_offsets.reserve(stop_names.size() + 1);
+  stop_visits_offsets.push_back(0);
+  for (const size_t visit_count : stop_visit_counts) {
+    stop_visits_offsets.push_back(stop_visits_offsets.back() + visit_count);
+  }
+  auto& stop_visits = stop_visits_.Edit();
+  stop_visits.resize(route_stops.size());
+  vector<size_t> next_visit_idx(begin(stop_visits_offsets), prev(end(stop_visits_offsets)));
+  for (BusId bus_id = 0; bus_id < routes.size(); ++bus_id) {
+    for (size_t position = routes[bus_id].begin; position < routes[bus_id].end; ++position) {
+      stop_visits[next_visit_idx[route_stops[position]]++] = {bus_id, position};
+    }
+  }
+}
+
+RaptorRouter::RaptorRouter(Snapshot::Reader& reader)
+    : bus_wait_time_(reader.ReadValue<double>()),
+      bus_velocity_(reader.ReadValue<double>()),
+      bus_routes_(reader.ReadMappedArray<BusRoute>()),
+      bus_name_ids_(reader.ReadMappedArray<NameId>()),
+      route_stops_(reader.ReadMappedArray<StopId>()),
+      route_distances_(reader.ReadMappedArray<int>()),
+      stop_visits_offsets_(reader.ReadMappedArray<size_t>()),
+      stop_visits_(reader.ReadMappedArray<StopVisit>())
+{
+  if (stop_visits_offsets_.empty() || bus_name_ids_.size() != bus_routes_.size()
+      || route_distances_.size() != route_stops_.size()) {
+    throw Snapshot::FormatError("malformed bus routes");
+  }
+}
+
+void RaptorRouter::Serialize(Snapshot::Writer& writer) const {
+  writer.WriteValue(bus_wait_time_);
+  writer.WriteValue(bus_velocity_);
+  writer.WriteArray(bus_routes_);
+  writer.WriteArray(bus_name_ids_);
+  writer.WriteArray(route_stops_);
+  writer.WriteArray(route_distances_);
+  writer.WriteArray(stop_visits_offsets_);
+  writer.WriteArray(stop_visits_);
+}
+
+double RaptorRouter::ComputeRideTime(size_t board_position, size_t alight_position) const {
+  const int distance = route_distances_[alight_position] - route_distances_[board_position];
+  return distance * 1.0 / (bus_velocity_ * 1000.0 / 60);  // m / (km/h * 1000 / 60) = min
+}
+
+void RaptorRouter::ScanBus(BusId bus_id, size_t first_position, SearchState& state) const {
+  // The arrays may be owned or mapped, which is checked once here rather than on every access
+  const StopId* const route_stops = route_stops_.data();
+  const size_t end_position = bus_routes_[bus_id].end;
+  size_t board_position = NO_POSITION;
+  double board_time = NO_TIME;
+  for (size_t position = first_position; position < end_position; ++position) {
+    const StopId stop_id = route_stops[position];
+    double ride_arrival_time = NO_TIME;
+    if (board_position != NO_POSITION) {
+      ride_arrival_time = board_time + ComputeRideTime(board_position, position);
+      // Arrivals later than the best known one at the destination can't be useful
+      if (ride_arrival_time < state.GetBestTime(stop_id) && ride_arrival_time < state.GetBestTime(state.stop_to)) {
+        state.Improve(stop_id, ride_arrival_time, board_position, position, bus_id);
+      }
+    }
+
+    // Boarding here again is better than staying on if the bus is reached earlier this way
+    const double prev_time = state.GetPrevTime(stop_id);
+    if (prev_time != NO_TIME && prev_time + bus_wait_time_ < ride_arrival_time) {
+      board_position = position;
+      board_time = prev_time + bus_wait_time_;
+    }
+  }
+}
+
+void RaptorRouter::SearchState::Reset(size_t stop_count, size_t bus_count) {
+  if (marks.size() < stop_count) {
+    prev_times.resize(stop_count);
+    best_times.resize(stop_count);
+    last_labels.resize(stop_count);
+    is_improved.resize(stop_count, false);
+    marks.resize(stop_count, current_mark);
+  }
+  if (first_positions.size() < bus_count) {
+    first_positions.resize(bus_count, NO_POSITION);
+  }
+  if (++current_mark == 0) {
+    fill(begin(marks), end(marks), 0);
+    current_mark = 1;
+  }
+  labels.clear();
+  round = 0;
+}
+
+double RaptorRouter::SearchState::GetPrevTime(StopId stop_id) const {
+  return marks[stop_id] == current_mark ? prev_times[stop_id] : NO_TIME;
+}
+
+double RaptorRouter::SearchState::GetBestTime(StopId stop_id) const {
+  return marks[stop_id] == current_mark ? best_times[stop_id] : NO_TIME;
+}
+
+void RaptorRouter::SearchState::Improve(StopId stop_id, double time, size_t board_position, size_t alight_position,
+                                        BusId bus_id) {
+  if (marks[stop_id] != current_mark) {
+    marks[stop_id] = current_mark;
+    prev_times[stop_id] = NO_TIME;
+    last_labels[stop_id] = NO_LABEL;
+  }
+  best_times[stop_id] = time;
+
+  const size_t last_label = last_labels[stop_id];
+  if (last_label != NO_LABEL && labels[last_label].round == round) {
+    labels[last_label] = {time, board_position, alight_position, bus_id, round, labels[last_label].prev_label};
+  } else {
+    labels.push_back({time, board_position, alight_position, bus_id, round, last_label});
+    last_labels[stop_id] = labels.size() - 1;
+  }
+
+  if (!is_improved[stop_id]) {
+    is_improved[stop_id] = true;
+    improved_stops.push_back(stop_id);
+  }
+}
+
+void RaptorRouter::SearchState::FinishRound() {
+  for (const StopId stop_id : improved_stops) {
+    prev_times[stop_id] = best_times[stop_id];
+  }
+  ++round;
+}
+
+optional<TransportRouter::RouteInfo> RaptorRouter::FindRoute(NameId stop_from, NameId stop_to) const {
+  thread_local SearchState state;
+  state.Reset(stop_visits_offsets_.size() - 1, bus_routes_.size());
+  state.stop_to = stop_to;
+  state.Improve(stop_from, 0, NO_POSITION, NO_POSITION, 0);
+
+  while (!state.improved_stops.empty()) {
+    state.FinishRound();
+    // Each bus is scanned once per round, from the first stop improved in the previous round
+    for (const StopId stop_id : state.improved_stops) {
+      for (size_t visit_idx = stop_visits_offsets_[stop_id]; visit_idx < stop_visits_offsets_[stop_id + 1]; ++visit_idx) {
+        const auto [bus_id, position] = stop_visits_[visit_idx];
+        state.first_positions[bus_id] = min(state.first_positions[bus_id], position);
+      }
+      state.is_improved[stop_id] = false;
+    }
+    state.improved_stops.clear();
+
+    for (BusId bus_id = 0; bus_id < bus_routes_.size(); ++bus_id) {
+      if (state.first_positions[bus_id] != NO_POSITION) {
+        ScanBus(bus_id, state.first_positions[bus_id], state);
+        state.first_positions[bus_id] = NO_POSITION;
+      }
+    }
+  }
+
+  if (state.GetBestTime(stop_to) == NO_TIME) {
+    return nullopt;
+  }
+  return BuildRouteInfo(state);
+}
+
+TransportRouter::RouteInfo RaptorRouter::BuildRouteInfo(const SearchState& state) const {
+  using RouteInfo = TransportRouter::RouteInfo;
+  RouteInfo route_info = {.total_time = state.best_times[state.stop_to]};
+
+  size_t label_idx = state.last_labels[state.stop_to];
+  while (state.labels[label_idx].board_position != NO_POSITION) {
+    const Label& label = state.labels[label_idx];
+    route_info.items.push_back(RouteInfo::BusItem{
+        .bus_id = bus_name_ids_[label.bus_id],
+        .time = ComputeRideTime(label.board_position, label.alight_position),
+        .span_count = label.alight_position - label.board_position,
+    });
+    const StopId stop_id = route_stops_[label.board_position];
+    route_info.items.push_back(RouteInfo::WaitItem{
+        .stop_id = stop_id,
+        .time = bus_wait_time_,
+    });
+    // The bus was boarded after an arrival of an earlier round
+    label_idx = state.last_labels[stop_id];
+    while (state.labels[label_idx].round >= label.round) {
+      label_idx = state.labels[label_idx].prev_label;
+    }
+  }
+  reverse(begin(route_info.items), end(route_info.items));
+
+  return route_info;
+}
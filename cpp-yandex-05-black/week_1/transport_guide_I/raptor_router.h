@@ -0,0 +1,109 @@
+#pragma once
+
+#include "descriptions.h"
+#include "json.h"
+#include "name_interner.h"
+#include "road_distances.h"
+#include "snapshot.h"
+#include "transport_router.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// Round-based public transit router (RAPTOR): round k finds the best routes with k buses
+// by scanning every bus that serves a stop improved in round k - 1.
+// Works on plain arrays of bus stops, no graph is built.
+class RaptorRouter {
+public:
+  // Stops and buses are identified by ids of stop_names and bus_names, bus_routes are by bus id
+  RaptorRouter(const Descriptions::BusesDict& buses_dict,
+               const Json::Dict& routing_settings_json,
+               const NameInterner& stop_names,
+               const NameInterner& bus_names,
+               const std::vector<BusRoadRoute>& bus_routes);
+  // Router written by Serialize, viewed in the mapping of the reader
+  explicit RaptorRouter(Snapshot::Reader& reader);
+
+  void Serialize(Snapshot::Writer& writer) const;
+
+  std::optional<TransportRouter::RouteInfo> FindRoute(NameId stop_from, NameId stop_to) const;
+
+private:
+  using StopId = NameId;
+  using BusId = size_t;  // only buses with rides, in order of names
+
+  // Positions of the bus stops in route_stops_ and route_distances_
+  struct BusRoute {
+    size_t begin;
+    size_t end;
+  };
+
+  // Stop position in route_stops_
+  struct StopVisit {
+    BusId bus_id;
+    size_t position;
+  };
+
+  // How an arrival found in a round was achieved; the origin has no positions
+  struct Label {
+    double time;
+    // Positions in route_stops_
+    size_t board_position;
+    size_t alight_position;
+    BusId bus_id;
+    size_t round;
+    size_t prev_label;  // earlier label of the same stop, or NO_LABEL
+  };
+
+  static constexpr size_t NO_POSITION = static_cast<size_t>(-1);
+  static constexpr size_t NO_LABEL = static_cast<size_t>(-1);
+
+  double bus_wait_time_;  // in minutes
+  double bus_velocity_;  // km/h
+
+  Snapshot::Array<BusRoute> bus_routes_;
+  Snapshot::Array<NameId> bus_name_ids_;  // by BusId too
+  // Stops of all buses, bus after bus
+  Snapshot::Array<StopId> route_stops_;
+  // Road distance from the first stop of the bus
+  Snapshot::Array<int> route_distances_;
+
+  // Visits of stop s are stop_visits_[stop_visits_offsets_[s] .. stop_visits_offsets_[s + 1])
+  Snapshot::Array<size_t> stop_visits_offsets_;
+  Snapshot::Array<StopVisit> stop_visits_;
+
+  // Buffers reused by the searches of a thread. Values by stop are valid only for the stops
+  // reached in the current search, which is told by marks, so a search doesn't clear them.
+  struct SearchState {
+    std::vector<uint32_t> marks;
+    uint32_t current_mark = 0;
+    // Best arrivals using the buses of the previous rounds, and of the current one too
+    std::vector<double> prev_times;
+    std::vector<double> best_times;
+    // Every arrival found, linked into one list per stop, latest first
+    std::vector<Label> labels;
+    std::vector<size_t> last_labels;
+    // Stops improved in the current round; is_improved is all false between rounds
+    std::vector<StopId> improved_stops;
+    std::vector<bool> is_improved;
+    // Scan start of each bus in the current round; all NO_POSITION between rounds
+    std::vector<size_t> first_positions;
+    size_t round = 0;
+    StopId stop_to = 0;
+
+    void Reset(size_t stop_count, size_t bus_count);
+    double GetPrevTime(StopId stop_id) const;
+    double GetBestTime(StopId stop_id) const;
+    // Records an arrival of the current round, replacing the one of the same round if any
+    void Improve(StopId stop_id, double time, size_t board_position, size_t alight_position, BusId bus_id);
+    // Makes the arrivals of the current round usable as ones of a previous round
+    void FinishRound();
+  };
+
+  double ComputeRideTime(size_t board_position, size_t alight_position) const;
+
+  void ScanBus(BusId bus_id, size_t first_position, SearchState& state) const;
+
+  TransportRouter::RouteInfo BuildRouteInfo(const SearchState& state) const;
+};
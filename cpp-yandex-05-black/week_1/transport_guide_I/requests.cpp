@@ -1,88 +1,118 @@
 #include "requests.h"
 #include "transport_router.h"
+#include "utils.h"
 
+#include <algorithm>
+#include <limits>
+#include <string>
 #include <vector>
 
 using namespace std;
 
 namespace Requests {
 
-  Json::Dict Stop::Process(const TransportCatalog& db) const {
-    const auto* stop = db.GetStop(name);
-    Json::Dict dict;
-    if (!stop) {
-      dict["error_message"] = Json::Node("not found"s);
+  static void WriteNotFound(int request_id, Json::Writer& writer) {
+    writer.StartObject();
+    writer.Key("error_message").Value("not found");
+    writer.Key("request_id").Value(request_id);
+    writer.EndObject();
+  }
+
+  void Stop::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    if (const auto* response = db.GetStopResponse(name)) {
+      writer.Value(*response, request_id);
     } else {
-      Json::Array bus_nodes;
-      bus_nodes.reserve(stop->bus_names.size());
-      for (const auto& bus_name : stop->bus_names) {
-        bus_nodes.emplace_back(bus_name);
-      }
-      dict["buses"] = Json::Node(move(bus_nodes));
+      WriteNotFound(request_id, writer);
     }
-    return dict;
   }
 
-  Json::Dict Bus::Process(const TransportCatalog& db) const {
-    const auto* bus = db.GetBus(name);
-    Json::Dict dict;
-    if (!bus) {
-      dict["error_message"] = Json::Node("not found"s);
+  void Bus::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    if (const auto* response = db.GetBusResponse(name)) {
+      writer.Value(*response, request_id);
     } else {
-      dict = {
-          {"stop_count", Json::Node(static_cast<int>(bus->stop_count))},
-          {"unique_stop_count", Json::Node(static_cast<int>(bus->unique_stop_count))},
-          {"route_length", Json::Node(bus->road_route_length)},
-          {"curvature", Json::Node(bus->road_route_length / bus->geo_route_length)},
-      };
+      WriteNotFound(request_id, writer);
     }
-    return dict;
   }
 
-  struct RouteItemResponseBuilder {
-    Json::Dict operator()(const TransportRouter::RouteInfo::BusItem& bus_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Bus"s)},
-          {"bus", Json::Node(bus_item.bus_name)},
-          {"time", Json::Node(bus_item.time)},
-          {"span_count", Json::Node(static_cast<int>(bus_item.span_count))}
-      };
+  struct RouteItemResponseWriter {
+    const TransportCatalog& db;
+    Json::Writer& writer;
+
+    void operator()(const TransportRouter::RouteInfo::BusItem& bus_item) const {
+      writer.StartObject();
+      writer.Key("bus").Value(db.GetBusName(bus_item.bus_id));
+      writer.Key("span_count").Value(static_cast<int>(bus_item.span_count));
+      writer.Key("time").Value(bus_item.time);
+      writer.Key("type").Value("Bus");
+      writer.EndObject();
     }
-    Json::Dict operator()(const TransportRouter::RouteInfo::WaitItem& wait_item) const {
-      return Json::Dict{
-          {"type", Json::Node("Wait"s)},
-          {"stop_name", Json::Node(wait_item.stop_name)},
-          {"time", Json::Node(wait_item.time)},
-      };
+    void operator()(const TransportRouter::RouteInfo::WaitItem& wait_item) const {
+      writer.StartObject();
+      writer.Key("stop_name").Value(db.GetStopName(wait_item.stop_id));
+      writer.Key("time").Value(wait_item.time);
+      writer.Key("type").Value("Wait");
+      writer.EndObject();
     }
   };
 
-  Json::Dict Route::Process(const TransportCatalog& db) const {
-    Json::Dict dict;
+  void Route::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
     const auto route = db.FindRoute(stop_from, stop_to);
     if (!route) {
-      dict["error_message"] = Json::Node("not found"s);
+      WriteNotFound(request_id, writer);
     } else {
-      dict["total_time"] = Json::Node(route->total_time);
-      Json::Array items;
-      items.reserve(route->items.size());
+      writer.StartObject();
+      writer.Key("items").StartArray();
       for (const auto& item : route->items) {
-        items.push_back(visit(RouteItemResponseBuilder{}, item));
+        visit(RouteItemResponseWriter{db, writer}, item);
       }
+      writer.EndArray();
+      writer.Key("request_id").Value(request_id);
+      writer.Key("total_time").Value(route->total_time);
+      writer.EndObject();
+    }
+  }
 
-      dict["items"] = move(items);
+  void NearestStops::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    writer.StartObject();
+    writer.Key("request_id").Value(request_id);
+    writer.Key("stops").StartArray();
+    for (const auto& [stop_id, distance] : db.FindNearestStops(position, max_count, max_distance)) {
+      writer.StartObject();
+      writer.Key("distance").Value(distance);
+      writer.Key("stop_name").Value(db.GetStopName(stop_id));
+      writer.EndObject();
     }
+    writer.EndArray();
+    writer.EndObject();
+  }
 
-    return dict;
+  void Map::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    writer.StartObject();
+    writer.Key("map").RawValue(db.RenderMapJson());
+    writer.Key("request_id").Value(request_id);
+    writer.EndObject();
   }
 
-  Json::Dict Map::Process(const TransportCatalog& db) const {
-    return Json::Dict{
-        {"map", Json::Node(db.RenderMap())},
-    };
+  optional<Svg::ViewBox> MapTile::GetViewport(const TransportCatalog& db) const {
+    if (const auto* tile_id = get_if<TileId>(&area)) {
+      return db.GetMapTileViewport(tile_id->zoom, tile_id->x, tile_id->y);
+    }
+    return get<Svg::ViewBox>(area);
+  }
+
+  void MapTile::Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const {
+    const auto viewport = GetViewport(db);
+    if (!viewport) {
+      WriteNotFound(request_id, writer);
+      return;
+    }
+    writer.StartObject();
+    writer.Key("map").RawValue(db.RenderMapTile(*viewport)->svg_json);
+    writer.Key("request_id").Value(request_id);
+    writer.EndObject();
   }
 
-  variant<Stop, Bus, Route, Map> Read(const Json::Dict& attrs) {
+  variant<Stop, Bus, Route, NearestStops, Map, MapTile> Read(const Json::Dict& attrs) {
     const string& type = attrs.at("type").AsString();
     if (type == "Bus") {
       return Bus{attrs.at("name").AsString()};
@@ -90,23 +120,65 @@ namespace Requests {
       return Stop{attrs.at("name").AsString()};
     } else if (type == "Route") {
       return Route{attrs.at("from").AsString(), attrs.at("to").AsString()};
+    } else if (type == "NearestStops") {
+      // Both limits are optional
+      return NearestStops{
+          .position = {attrs.at("latitude").AsDouble(), attrs.at("longitude").AsDouble()},
+          .max_count = attrs.count("count") > 0
+                       ? static_cast<size_t>(max(0, attrs.at("count").AsInt()))
+                       : numeric_limits<size_t>::max(),
+          .max_distance = attrs.count("radius") > 0
+                          ? attrs.at("radius").AsDouble()
+                          : numeric_limits<double>::infinity(),
+      };
+    } else if (type == "MapTile") {
+      // Either "bbox": [min_x, min_y, max_x, max_y] or "zoom", "x" and "y"
+      if (attrs.count("bbox") > 0) {
+        const auto& bbox = attrs.at("bbox").AsArray();
+        const Svg::Point min{bbox.at(0).AsDouble(), bbox.at(1).AsDouble()};
+        return MapTile{Svg::ViewBox{
+            .min = min,
+            .width = bbox.at(2).AsDouble() - min.x,
+            .height = bbox.at(3).AsDouble() - min.y,
+        }};
+      }
+      return MapTile{MapTile::TileId{attrs.at("zoom").AsInt(), attrs.at("x").AsInt(), attrs.at("y").AsInt()}};
     } else {
       return Map{};
     }
   }
 
-  Json::Array ProcessAll(const TransportCatalog& db, const Json::Array& requests) {
-    Json::Array responses;
-    responses.reserve(requests.size());
-    for (const Json::Node& request_node : requests) {
-      Json::Dict dict = visit([&db](const auto& request) {
-                                return request.Process(db);
-                              },
-                              Requests::Read(request_node.AsMap()));
-      dict["request_id"] = Json::Node(request_node.AsMap().at("id").AsInt());
-      responses.push_back(Json::Node(dict));
+  void WriteAll(const TransportCatalog& db, const Json::Array& requests, ostream& output, size_t thread_count) {
+    static constexpr size_t CHUNK_SIZE = 1024;  // requests per thread and round
+
+    thread_count = max<size_t>(1, thread_count);
+    vector<string> buffers(thread_count);
+    output << '[';
+    // In every round each thread serializes its chunk, then the chunks are flushed in order
+    for (size_t round_begin = 0; round_begin < requests.size(); round_begin += CHUNK_SIZE * thread_count) {
+      ParallelFor(thread_count, [&](size_t chunk_idx) {
+        string& buffer = buffers[chunk_idx];
+        buffer.clear();
+        Json::Writer writer(buffer);
+        const size_t chunk_begin = min(requests.size(), round_begin + chunk_idx * CHUNK_SIZE);
+        const size_t chunk_end = min(requests.size(), chunk_begin + CHUNK_SIZE);
+        for (size_t request_idx = chunk_begin; request_idx < chunk_end; ++request_idx) {
+          if (request_idx > 0) {
+            buffer += ", ";
+          }
+          const Json::Dict& request_attrs = requests[request_idx].AsMap();
+          const int request_id = request_attrs.at("id").AsInt();
+          visit([&](const auto& request) {
+                  request.Write(db, request_id, writer);
+                },
+                Requests::Read(request_attrs));
+        }
+      }, thread_count);
+      for (const string& buffer : buffers) {
+        output.write(buffer.data(), buffer.size());
+      }
     }
-    return responses;
+    output << ']';
   }
 
 }
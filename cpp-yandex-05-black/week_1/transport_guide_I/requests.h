@@ -1,37 +1,70 @@
 #pragma once
 
 #include "json.h"
+#include "sphere.h"
+#include "svg.h"
 #include "transport_catalog.h"
 
+#include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <variant>
 
 
 namespace Requests {
+  // Names are views into the request attributes, which must outlive the request
   struct Stop {
-    std::string name;
+    std::string_view name;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
   struct Bus {
-    std::string name;
+    std::string_view name;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
   struct Route {
-    std::string stop_from;
-    std::string stop_to;
+    std::string_view stop_from;
+    std::string_view stop_to;
 
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  // Stops around the position, nearest first: at most max_count of them, not farther than max_distance meters
+  struct NearestStops {
+    Sphere::Point position;
+    size_t max_count;
+    double max_distance;
+
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
   };
 
   struct Map {
-    Json::Dict Process(const TransportCatalog& db) const;
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+  };
+
+  // Part of the map: a box in map coordinates or tile (x, y) of the 2^zoom by 2^zoom grid over it
+  struct MapTile {
+    struct TileId {
+      int zoom;
+      int x;
+      int y;
+    };
+    std::variant<Svg::ViewBox, TileId> area;
+
+    void Write(const TransportCatalog& db, int request_id, Json::Writer& writer) const;
+
+  private:
+    std::optional<Svg::ViewBox> GetViewport(const TransportCatalog& db) const;
   };
 
-  std::variant<Stop, Bus, Route, Map> Read(const Json::Dict& attrs);
+  std::variant<Stop, Bus, Route, NearestStops, Map, MapTile> Read(const Json::Dict& attrs);
 
-  Json::Array ProcessAll(const TransportCatalog& db, const Json::Array& requests);
+  // Prints the array of responses in thread_count threads; the catalog is only read.
+  // Responses are serialized into per-thread buffers, which are reused and flushed in large writes
+  void WriteAll(const TransportCatalog& db, const Json::Array& requests, std::ostream& output,
+                size_t thread_count = 1);
 }
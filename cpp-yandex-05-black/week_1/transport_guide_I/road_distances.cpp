@@ -0,0 +1,79 @@
+#include "road_distances.h"
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+RoadDistances::RoadDistances(const Descriptions::StopsDict& stops_dict, const NameInterner& stop_names)
+    : offsets_(stop_names.size() + 1, 0)
+{
+  // Distances to names which are not stops can never be asked for
+  for (const auto& [stop_name, stop] : stops_dict) {
+    for (const auto& [neighbour_name, _] : stop->distances) {
+      if (stop_names.Find(neighbour_name)) {
+        ++offsets_[stop_names.GetId(stop_name) + 1];
+      }
+    }
+  }
+  partial_sum(begin(offsets_), end(offsets_), begin(offsets_));
+
+  neighbours_.resize(offsets_.back());
+  distances_.resize(offsets_.back());
+  vector<size_t> next_positions(begin(offsets_), prev(end(offsets_)));
+  for (const auto& [stop_name, stop] : stops_dict) {
+    const NameId stop_id = stop_names.GetId(stop_name);
+    for (const auto& [neighbour_name, distance] : stop->distances) {
+      if (const auto neighbour_id = stop_names.Find(neighbour_name)) {
+        const size_t position = next_positions[stop_id]++;
+        neighbours_[position] = *neighbour_id;
+        distances_[position] = distance;
+      }
+    }
+  }
+
+  vector<pair<NameId, int>> row;
+  for (size_t stop_id = 0; stop_id + 1 < offsets_.size(); ++stop_id) {
+    row.clear();
+    for (size_t position = offsets_[stop_id]; position < offsets_[stop_id + 1]; ++position) {
+      row.emplace_back(neighbours_[position], distances_[position]);
+    }
+    sort(begin(row), end(row));
+    for (size_t idx = 0; idx < row.size(); ++idx) {
+      tie(neighbours_[offsets_[stop_id] + idx], distances_[offsets_[stop_id] + idx]) = row[idx];
+    }
+  }
+}
+
+const int* RoadDistances::Find(NameId stop_from, NameId stop_to) const {
+  const auto row_begin = begin(neighbours_) + offsets_[stop_from];
+  const auto row_end = begin(neighbours_) + offsets_[stop_from + 1];
+  const auto it = lower_bound(row_begin, row_end, stop_to);
+  return it != row_end && *it == stop_to ? &distances_[it - begin(neighbours_)] : nullptr;
+}
+
+int RoadDistances::Get(NameId stop_from, NameId stop_to) const {
+  if (const int* distance = Find(stop_from, stop_to)) {
+    return *distance;
+  }
+  if (const int* distance = Find(stop_to, stop_from)) {
+    return *distance;
+  }
+  throw out_of_range("no road distance between stops");
+}
+
+BusRoadRoute::BusRoadRoute(vector<NameId> route_stop_ids, const RoadDistances& road_distances)
+    : stop_ids(move(route_stop_ids))
+{
+  distances.reserve(stop_ids.size());
+  int distance = 0;
+  for (size_t stop_idx = 0; stop_idx < stop_ids.size(); ++stop_idx) {
+    if (stop_idx > 0) {
+      distance += road_distances.Get(stop_ids[stop_idx - 1], stop_ids[stop_idx]);
+    }
+    distances.push_back(distance);
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "descriptions.h"
+#include "name_interner.h"
+
+#include <vector>
+
+// Road distances between stops by stop id in compressed sparse rows:
+// distances given for stop s are at [offsets_[s], offsets_[s + 1]), sorted by neighbour id
+class RoadDistances {
+public:
+  RoadDistances(const Descriptions::StopsDict& stops_dict, const NameInterner& stop_names);
+
+  // Distance given for stop_from, or the one given for stop_to if there is none.
+  // Throws std::out_of_range if neither is given.
+  int Get(NameId stop_from, NameId stop_to) const;
+
+private:
+  std::vector<size_t> offsets_;
+  std::vector<NameId> neighbours_;
+  std::vector<int> distances_;
+
+  const int* Find(NameId stop_from, NameId stop_to) const;
+};
+
+// Stops of a bus with road distances from its first stop,
+// so that the distance of any span of the route is a difference
+struct BusRoadRoute {
+  std::vector<NameId> stop_ids;
+  std::vector<int> distances;
+
+  BusRoadRoute() = default;
+  BusRoadRoute(std::vector<NameId> route_stop_ids, const RoadDistances& road_distances);
+
+  int GetLength() const {
+    return distances.empty() ? 0 : distances.back();
+  }
+
+  int GetDistance(size_t from_idx, size_t to_idx) const {
+    return distances[to_idx] - distances[from_idx];
+  }
+};
@@ -1,27 +1,33 @@
 #pragma once
 
+#include "expanded_routes.h"
 #include "graph.h"
+#include "utils.h"
 
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace Graph {
 
-  template <typename Weight>
+  // All-pairs routes table. TableWeight and TableEdgeId set how a vertex pair is stored:
+  // Router<double, float> takes 8 bytes per pair at the cost of float precision of route weights.
+  template <typename Weight, typename TableWeight = Weight, typename TableEdgeId = uint32_t>
   class Router {
   private:
     using Graph = DirectedWeightedGraph<Weight>;
 
   public:
     Router(const Graph& graph);
+    // Table written by Serialize for the same graph, viewed in the mapping of the reader
+    Router(const Graph& graph, Snapshot::Reader& reader);
 
-    using RouteId = uint64_t;
+    using RouteId = ExpandedRoutes::RouteId;
 
     struct RouteInfo {
       RouteId id;
@@ -29,110 +35,188 @@ namespace Graph {
       size_t edge_count;
     };
 
+    // Replaces the contents of route_edges with the route edges and returns the route weight.
+    // Reuses the buffer capacity and keeps no state, so nothing has to be released.
+    std::optional<Weight> BuildRoute(VertexId from, VertexId to, std::vector<EdgeId>& route_edges) const;
+
+    // Same route kept inside the router until ReleaseRoute
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
     EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
     void ReleaseRoute(RouteId route_id);
 
+    void Serialize(Snapshot::Writer& writer) const;
+
   private:
+    static_assert(std::numeric_limits<TableWeight>::has_infinity);
+    static constexpr TableWeight NO_ROUTE = std::numeric_limits<TableWeight>::infinity();
+    static constexpr TableEdgeId NO_TABLE_EDGE = std::numeric_limits<TableEdgeId>::max();
+
+    // Floyd-Warshall runs over square blocks of this size, so that
+    // the three blocks touched by one relaxation stay in cache together
+    static constexpr size_t BLOCK_SIZE = 64;
+
     const Graph& graph_;
+    const size_t vertex_count_;
 
-    struct RouteInternalData {
-      Weight weight;
-      std::optional<EdgeId> prev_edge;
-    };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
+    // Row-major vertex_count_ x vertex_count_ matrices.
+    // Unreachable pairs have NO_ROUTE weight; they and the diagonal have NO_TABLE_EDGE prev edge.
+    Snapshot::Array<TableWeight> weights_;
+    Snapshot::Array<TableEdgeId> prev_edges_;
 
-    using ExpandedRoute = std::vector<EdgeId>;
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
+    mutable ExpandedRoutes expanded_routes_;
 
     void InitializeRoutesInternalData(const Graph& graph) {
-      const size_t vertex_count = graph.GetVertexCount();
-      for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-        routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
+      assert(graph.GetEdgeCount() < NO_TABLE_EDGE);
+      auto& weights = weights_.Edit();
+      auto& prev_edges = prev_edges_.Edit();
+      for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        weights[vertex * vertex_count_ + vertex] = 0;
         for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
           const auto& edge = graph.GetEdge(edge_id);
           assert(edge.weight >= 0);
-          auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-          if (!route_internal_data || route_internal_data->weight > edge.weight) {
-            route_internal_data = RouteInternalData{edge.weight, edge_id};
+          const size_t route_idx = vertex * vertex_count_ + edge.to;
+          const auto edge_weight = static_cast<TableWeight>(edge.weight);
+          if (weights[route_idx] > edge_weight) {
+            weights[route_idx] = edge_weight;
+            prev_edges[route_idx] = static_cast<TableEdgeId>(edge_id);
           }
         }
       }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                    const RouteInternalData& route_from, const RouteInternalData& route_to) {
-      auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-      const Weight candidate_weight = route_from.weight + route_to.weight;
-      if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-        route_relaxing = {
-            candidate_weight,
-            route_to.prev_edge
-                ? route_to.prev_edge
-                : route_from.prev_edge
-        };
+    // Relaxes routes from vertices of rows_block to vertices of cols_block
+    // through vertices of through_block
+    void RelaxBlock(size_t rows_block, size_t cols_block, size_t through_block) {
+      const size_t rows_end = std::min(vertex_count_, (rows_block + 1) * BLOCK_SIZE);
+      const size_t cols_begin = cols_block * BLOCK_SIZE;
+      const size_t cols_end = std::min(vertex_count_, cols_begin + BLOCK_SIZE);
+      const size_t through_end = std::min(vertex_count_, (through_block + 1) * BLOCK_SIZE);
+      TableWeight* const weights = weights_.Edit().data();
+      TableEdgeId* const prev_edges = prev_edges_.Edit().data();
+
+      // Blocks of the through block row and column depend on themselves,
+      // so vertex_through has to be the outermost loop
+      for (VertexId vertex_through = through_block * BLOCK_SIZE; vertex_through < through_end; ++vertex_through) {
+        const TableWeight* const weights_through = weights + vertex_through * vertex_count_;
+        const TableEdgeId* const prev_edges_through = prev_edges + vertex_through * vertex_count_;
+        for (VertexId vertex_from = rows_block * BLOCK_SIZE; vertex_from < rows_end; ++vertex_from) {
+          TableWeight* const weights_from = weights + vertex_from * vertex_count_;
+          TableEdgeId* const prev_edges_from = prev_edges + vertex_from * vertex_count_;
+          const TableWeight weight_from = weights_from[vertex_through];
+          if (weight_from == NO_ROUTE) {
+            continue;
+          }
+          // Branchless min-plus step, so that the compiler can vectorize it
+          for (VertexId vertex_to = cols_begin; vertex_to < cols_end; ++vertex_to) {
+            const TableWeight candidate_weight = weight_from + weights_through[vertex_to];
+            const bool is_better = candidate_weight < weights_from[vertex_to];
+            weights_from[vertex_to] = is_better ? candidate_weight : weights_from[vertex_to];
+            prev_edges_from[vertex_to] = is_better ? prev_edges_through[vertex_to] : prev_edges_from[vertex_to];
+          }
+        }
       }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
-      for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-        if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-          for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-            if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-              RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-            }
+    // Blocked Floyd-Warshall step: the diagonal block depends only on itself,
+    // blocks of its row and column depend only on themselves and the diagonal one,
+    // and all other blocks only on row and column ones, so each phase is parallel
+    void RelaxRoutesInternalDataThroughBlock(size_t block_count, size_t through_block) {
+      RelaxBlock(through_block, through_block, through_block);
+
+      ParallelFor(block_count, [this, through_block](size_t block) {
+        if (block != through_block) {
+          RelaxBlock(through_block, block, through_block);
+          RelaxBlock(block, through_block, through_block);
+        }
+      });
+
+      ParallelFor(block_count, [this, block_count, through_block](size_t rows_block) {
+        if (rows_block == through_block) {
+          return;
+        }
+        for (size_t cols_block = 0; cols_block < block_count; ++cols_block) {
+          if (cols_block != through_block) {
+            RelaxBlock(rows_block, cols_block, through_block);
           }
         }
-      }
+      });
     }
-
-    RoutesInternalData routes_internal_data_;
   };
 
 
-  template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  Router<Weight, TableWeight, TableEdgeId>::Router(const Graph& graph)
       : graph_(graph),
-        routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+        vertex_count_(graph.GetVertexCount()),
+        weights_(std::vector<TableWeight>(vertex_count_ * vertex_count_, NO_ROUTE)),
+        prev_edges_(std::vector<TableEdgeId>(vertex_count_ * vertex_count_, NO_TABLE_EDGE))
   {
     InitializeRoutesInternalData(graph);
 
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
-      RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    const size_t block_count = (vertex_count_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (size_t through_block = 0; through_block < block_count; ++through_block) {
+      RelaxRoutesInternalDataThroughBlock(block_count, through_block);
     }
   }
 
-  template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_[from][to];
-    if (!route_internal_data) {
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  Router<Weight, TableWeight, TableEdgeId>::Router(const Graph& graph, Snapshot::Reader& reader)
+      : graph_(graph),
+        vertex_count_(graph.GetVertexCount()),
+        weights_(reader.ReadMappedArray<TableWeight>()),
+        prev_edges_(reader.ReadMappedArray<TableEdgeId>())
+  {
+    if (weights_.size() != vertex_count_ * vertex_count_ || prev_edges_.size() != weights_.size()) {
+      throw Snapshot::FormatError("malformed routes table");
+    }
+  }
+
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  std::optional<Weight> Router<Weight, TableWeight, TableEdgeId>::BuildRoute(VertexId from, VertexId to,
+                                                                             std::vector<EdgeId>& route_edges) const {
+    const size_t row_offset = from * vertex_count_;
+    if (weights_[row_offset + to] == NO_ROUTE) {
       return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
-    std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
-      edges.push_back(*edge_id);
+    // Summing original edge weights keeps full precision even if TableWeight is narrower
+    Weight weight = 0;
+    route_edges.clear();
+    for (TableEdgeId edge_id = prev_edges_[row_offset + to];
+         edge_id != NO_TABLE_EDGE;
+         edge_id = prev_edges_[row_offset + graph_.GetEdge(edge_id).from]) {
+      weight += graph_.GetEdge(edge_id).weight;
+      route_edges.push_back(edge_id);
     }
-    std::reverse(std::begin(edges), std::end(edges));
+    std::reverse(std::begin(route_edges), std::end(route_edges));
+    return weight;
+  }
 
-    const RouteId route_id = next_route_id_++;
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  std::optional<typename Router<Weight, TableWeight, TableEdgeId>::RouteInfo>
+  Router<Weight, TableWeight, TableEdgeId>::BuildRoute(VertexId from, VertexId to) const {
+    std::vector<EdgeId> edges;
+    const auto weight = BuildRoute(from, to, edges);
+    if (!weight) {
+      return std::nullopt;
+    }
     const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
+    return RouteInfo{expanded_routes_.Add(std::move(edges)), *weight, route_edge_count};
+  }
+
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  EdgeId Router<Weight, TableWeight, TableEdgeId>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
+    return expanded_routes_.GetEdge(route_id, edge_idx);
   }
 
-  template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  void Router<Weight, TableWeight, TableEdgeId>::ReleaseRoute(RouteId route_id) {
+    expanded_routes_.Release(route_id);
   }
 
-  template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+  template <typename Weight, typename TableWeight, typename TableEdgeId>
+  void Router<Weight, TableWeight, TableEdgeId>::Serialize(Snapshot::Writer& writer) const {
+    writer.WriteArray(weights_);
+    writer.WriteArray(prev_edges_);
   }
 
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  constexpr EdgeId NO_EDGE = std::numeric_limits<EdgeId>::max();
+
+  // Scratch space of a single Dijkstra search, reused between searches.
+  // A vertex is reached in the current search iff its mark equals current_mark,
+  // so weights and prev_edges never have to be cleared between searches.
+  template <typename Weight>
+  struct SearchBuffers {
+    std::vector<Weight> weights;
+    std::vector<EdgeId> prev_edges;
+    std::vector<uint32_t> marks;
+    uint32_t current_mark = 0;
+    std::vector<std::pair<Weight, VertexId>> heap;
+
+    void Reset(size_t vertex_count);
+    bool IsReached(VertexId vertex) const;
+    void Reach(VertexId vertex, Weight weight, EdgeId prev_edge);
+
+    // Lower bound for the weight of any vertex still queued
+    std::optional<Weight> PeekClosestWeight() const;
+    // Skips heap entries outdated by later Reach calls
+    std::optional<VertexId> PopClosest();
+  };
+
+
+  template <typename Weight>
+  void SearchBuffers<Weight>::Reset(size_t vertex_count) {
+    if (marks.size() < vertex_count) {
+      weights.resize(vertex_count);
+      prev_edges.resize(vertex_count);
+      marks.resize(vertex_count, current_mark);
+    }
+    if (++current_mark == 0) {
+      std::fill(std::begin(marks), std::end(marks), 0);
+      current_mark = 1;
+    }
+    heap.clear();
+  }
+
+  template <typename Weight>
+  bool SearchBuffers<Weight>::IsReached(VertexId vertex) const {
+    return marks[vertex] == current_mark;
+  }
+
+  template <typename Weight>
+  void SearchBuffers<Weight>::Reach(VertexId vertex, Weight weight, EdgeId prev_edge) {
+    marks[vertex] = current_mark;
+    weights[vertex] = weight;
+    prev_edges[vertex] = prev_edge;
+    heap.emplace_back(weight, vertex);
+    std::push_heap(std::begin(heap), std::end(heap), std::greater<>{});
+  }
+
+  template <typename Weight>
+  std::optional<Weight> SearchBuffers<Weight>::PeekClosestWeight() const {
+    if (heap.empty()) {
+      return std::nullopt;
+    }
+    return heap.front().first;
+  }
+
+  template <typename Weight>
+  std::optional<VertexId> SearchBuffers<Weight>::PopClosest() {
+    while (!heap.empty()) {
+      std::pop_heap(std::begin(heap), std::end(heap), std::greater<>{});
+      const auto [weight, vertex] = heap.back();
+      heap.pop_back();
+      if (!(weights[vertex] < weight)) {
+        return vertex;
+      }
+    }
+    return std::nullopt;
+  }
+
+}
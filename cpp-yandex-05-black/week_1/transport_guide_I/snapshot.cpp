@@ -0,0 +1,150 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+
+namespace Snapshot {
+
+  static constexpr char MAGIC[8] = {'T', 'G', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t size_t_size;  // layouts of sections depend on it
+    uint64_t section_count;
+  };
+
+  static size_t AlignUp(size_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+  }
+
+  void Writer::WriteStrings(const vector<string>& values) {
+    vector<uint64_t> offsets;
+    offsets.reserve(values.size() + 1);
+    offsets.push_back(0);
+    string chars;
+    for (const string& value : values) {
+      chars += value;
+      offsets.push_back(chars.size());
+    }
+    WriteArray(offsets);
+    WriteString(chars);
+  }
+
+  void Writer::Save(const string& path) const {
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.size_t_size = sizeof(size_t);
+    header.section_count = sections_.size();
+
+    struct SectionEntry {
+      uint64_t offset;
+      uint64_t size;
+    };
+    vector<SectionEntry> entries;
+    entries.reserve(sections_.size());
+    size_t offset = AlignUp(sizeof(Header) + sections_.size() * sizeof(SectionEntry));
+    for (const string& section : sections_) {
+      entries.push_back({offset, section.size()});
+      offset = AlignUp(offset + section.size());
+    }
+
+    ofstream output(path, ios::binary);
+    if (!output) {
+      throw runtime_error("can't open " + path + " for writing");
+    }
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SectionEntry));
+    size_t position = sizeof(Header) + entries.size() * sizeof(SectionEntry);
+    for (size_t section_idx = 0; section_idx < sections_.size(); ++section_idx) {
+      const string padding(entries[section_idx].offset - position, '\0');
+      output.write(padding.data(), padding.size());
+      output.write(sections_[section_idx].data(), sections_[section_idx].size());
+      position = entries[section_idx].offset + sections_[section_idx].size();
+    }
+    if (!output) {
+      throw runtime_error("can't write " + path);
+    }
+  }
+
+  Reader::Reader(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw runtime_error("can't open " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+      close(fd);
+      throw FormatError(path + " is not a snapshot");
+    }
+    size_ = file_stat.st_size;
+    void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping stays valid
+    if (mapping == MAP_FAILED) {
+      throw runtime_error("can't map " + path);
+    }
+    data_ = static_cast<const char*>(mapping);
+
+    Header header;
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+      munmap(mapping, size_);
+      throw FormatError(path + " is not a snapshot");
+    }
+    if (header.version != VERSION || header.size_t_size != sizeof(size_t)) {
+      munmap(mapping, size_);
+      throw FormatError(path + " was written by an incompatible version");
+    }
+    const auto* entries = reinterpret_cast<const SectionEntry*>(data_ + sizeof(Header));
+    if (header.section_count > (size_ - sizeof(Header)) / sizeof(SectionEntry)) {
+      munmap(mapping, size_);
+      throw FormatError(path + " is truncated");
+    }
+    sections_ = {entries, entries + header.section_count};
+  }
+
+  Reader::~Reader() {
+    munmap(const_cast<char*>(data_), size_);
+  }
+
+  string_view Reader::ReadSection() {
+    if (next_section_idx_ == sections_.size()) {
+      throw FormatError("no more sections");
+    }
+    const SectionEntry& entry = *next(sections_.begin(), next_section_idx_++);
+    // Written so that the sum can't overflow
+    if (entry.offset > size_ || entry.size > size_ - entry.offset) {
+      throw FormatError("section out of file");
+    }
+    if (entry.offset % SECTION_ALIGNMENT != 0) {
+      throw FormatError("misaligned section");
+    }
+    return {data_ + entry.offset, entry.size};
+  }
+
+  vector<string> Reader::ReadStrings() {
+    const auto offsets = ReadArray<uint64_t>();
+    const string_view chars = ReadString();
+    if (offsets.size() == 0 || *offsets.begin() != 0 || *prev(offsets.end()) != chars.size()
+        || !is_sorted(offsets.begin(), offsets.end())) {
+      throw FormatError("malformed strings section");
+    }
+    vector<string> values;
+    values.reserve(offsets.size() - 1);
+    for (auto it = offsets.begin(); next(it) != offsets.end(); ++it) {
+      values.emplace_back(chars.substr(*it, *next(it) - *it));
+    }
+    return values;
+  }
+
+}
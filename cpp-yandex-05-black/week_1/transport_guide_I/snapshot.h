@@ -0,0 +1,178 @@
+#pragma once
+
+#include "utils.h"
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Binary snapshots of built objects. A file is a header, a table of section offsets and sizes,
+// and the sections: plain arrays of trivially copyable values, aligned so that
+// they can be used right in the mapped file. Objects write their sections in some order
+// and read them back in the same order, nothing in a file is a pointer.
+// Sections must not contain padding bytes, which would make snapshots differ from run to run:
+// structs with padding are written field by field.
+namespace Snapshot {
+
+  // Bump whenever the layout of any serialized object changes
+  constexpr uint32_t VERSION = 5;
+
+  // Of section offsets in a file; the mapping itself is page aligned
+  constexpr size_t SECTION_ALIGNMENT = 16;
+
+  class FormatError : public std::runtime_error {
+  public:
+    using runtime_error::runtime_error;
+  };
+
+  // Items of a built object, or a view of them in a mapped snapshot,
+  // so that a loaded object uses its arrays without copying them.
+  // Only owned items can be edited.
+  template <typename T>
+  class Array {
+  public:
+    Array() = default;
+    Array(std::vector<T> items) : items_(std::move(items)) {}
+    explicit Array(Range<const T*> view) : view_(view), is_view_(true) {}
+
+    const T* data() const {
+      return is_view_ ? view_.begin() : items_.data();
+    }
+    size_t size() const {
+      return is_view_ ? view_.size() : items_.size();
+    }
+    bool empty() const {
+      return size() == 0;
+    }
+
+    const T* begin() const {
+      return data();
+    }
+    const T* end() const {
+      return data() + size();
+    }
+
+    const T& operator[](size_t idx) const {
+      return data()[idx];
+    }
+    const T& front() const {
+      return data()[0];
+    }
+    const T& back() const {
+      return data()[size() - 1];
+    }
+
+    std::vector<T>& Edit() {
+      assert(!is_view_);
+      return items_;
+    }
+
+  private:
+    std::vector<T> items_;
+    Range<const T*> view_{nullptr, nullptr};
+    bool is_view_ = false;
+  };
+
+  class Writer {
+  public:
+    template <typename T>
+    void WriteArray(const T* items, size_t count) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      sections_.emplace_back(reinterpret_cast<const char*>(items), count * sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const std::vector<T>& items) {
+      WriteArray(items.data(), items.size());
+    }
+
+    template <typename T>
+    void WriteArray(const Array<T>& items) {
+      WriteArray(items.data(), items.size());
+    }
+
+    template <typename T>
+    void WriteValue(const T& value) {
+      WriteArray(&value, 1);
+    }
+
+    void WriteString(std::string_view value) {
+      WriteArray(value.data(), value.size());
+    }
+
+    void WriteStrings(const std::vector<std::string>& values);
+
+    void Save(const std::string& path) const;
+
+  private:
+    std::vector<std::string> sections_;
+  };
+
+  // Maps a snapshot file and reads its sections in the order they were written
+  class Reader {
+  public:
+    explicit Reader(const std::string& path);
+    ~Reader();
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // Valid while the reader is alive
+    template <typename T>
+    Range<const T*> ReadArray() {
+      static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= SECTION_ALIGNMENT);
+      const std::string_view section = ReadSection();
+      if (section.size() % sizeof(T) != 0) {
+        throw FormatError("section size mismatch");
+      }
+      const T* items = reinterpret_cast<const T*>(section.data());
+      return {items, items + section.size() / sizeof(T)};
+    }
+
+    // Same items viewed by an array, valid while the reader is alive
+    template <typename T>
+    Array<T> ReadMappedArray() {
+      return Array<T>(ReadArray<T>());
+    }
+
+    template <typename T>
+    std::vector<T> ReadVector() {
+      const auto items = ReadArray<T>();
+      return {items.begin(), items.end()};
+    }
+
+    template <typename T>
+    T ReadValue() {
+      const auto items = ReadArray<T>();
+      if (items.size() != 1) {
+        throw FormatError("section size mismatch");
+      }
+      return *items.begin();
+    }
+
+    std::string_view ReadString() {
+      return ReadSection();
+    }
+
+    std::vector<std::string> ReadStrings();
+
+  private:
+    struct SectionEntry {
+      uint64_t offset;
+      uint64_t size;
+    };
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    Range<const SectionEntry*> sections_{nullptr, nullptr};
+    size_t next_section_idx_ = 0;
+
+    std::string_view ReadSection();
+  };
+
+}
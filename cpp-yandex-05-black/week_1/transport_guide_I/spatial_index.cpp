@@ -0,0 +1,123 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+using namespace std;
+
+static double GetCoordinate(const Sphere::UnitVector& vector, size_t axis) {
+  switch (axis % 3) {
+    case 0:
+      return vector.x;
+    case 1:
+      return vector.y;
+    default:
+      return vector.z;
+  }
+}
+
+SpatialIndex::SpatialIndex(const vector<Sphere::Point>& points) {
+  vector<Node> nodes;
+  nodes.reserve(points.size());
+  for (NameId id = 0; id < points.size(); ++id) {
+    nodes.push_back({Sphere::UnitVector::FromPoint(points[id]), id});
+  }
+  Build(nodes, 0, nodes.size(), 0);
+
+  auto& node_vectors = node_vectors_.Edit();
+  auto& node_ids = node_ids_.Edit();
+  node_vectors.reserve(nodes.size());
+  node_ids.reserve(nodes.size());
+  for (const Node& node : nodes) {
+    node_vectors.push_back(node.vector);
+    node_ids.push_back(node.id);
+  }
+}
+
+SpatialIndex::SpatialIndex(Snapshot::Reader& reader)
+    : node_vectors_(reader.ReadMappedArray<Sphere::UnitVector>()),
+      node_ids_(reader.ReadMappedArray<NameId>())
+{
+  if (node_ids_.size() != node_vectors_.size()) {
+    throw Snapshot::FormatError("malformed spatial index");
+  }
+}
+
+void SpatialIndex::Serialize(Snapshot::Writer& writer) const {
+  writer.WriteArray(node_vectors_);
+  writer.WriteArray(node_ids_);
+}
+
+void SpatialIndex::Build(vector<Node>& nodes, size_t range_begin, size_t range_end, size_t depth) {
+  if (range_end - range_begin <= 1) {
+    return;
+  }
+  const size_t middle = range_begin + (range_end - range_begin) / 2;
+  nth_element(begin(nodes) + range_begin, begin(nodes) + middle, begin(nodes) + range_end,
+              [depth](const Node& lhs, const Node& rhs) {
+                return GetCoordinate(lhs.vector, depth) < GetCoordinate(rhs.vector, depth);
+              });
+  Build(nodes, range_begin, middle, depth + 1);
+  Build(nodes, middle + 1, range_end, depth + 1);
+}
+
+void SpatialIndex::SearchState::Add(Sphere::UnitVector vector, NameId id) {
+  const double chord = Sphere::ComputeChordLength(center, vector);
+  if (chord > max_chord) {
+    return;
+  }
+  nearest.emplace_back(chord, id);
+  push_heap(begin(nearest), end(nearest));
+  if (nearest.size() > max_count) {
+    pop_heap(begin(nearest), end(nearest));
+    nearest.pop_back();
+  }
+  if (nearest.size() == max_count) {
+    max_chord = nearest.front().first;
+  }
+}
+
+void SpatialIndex::Search(size_t range_begin, size_t range_end, size_t depth, SearchState& state) const {
+  if (range_begin == range_end) {
+    return;
+  }
+  const size_t middle = range_begin + (range_end - range_begin) / 2;
+  state.Add(node_vectors_[middle], node_ids_[middle]);
+
+  // The far side of the splitting plane is searched only if the plane is close enough
+  const double offset = GetCoordinate(state.center, depth) - GetCoordinate(node_vectors_[middle], depth);
+  if (offset < 0) {
+    Search(range_begin, middle, depth + 1, state);
+    if (-offset <= state.max_chord) {
+      Search(middle + 1, range_end, depth + 1, state);
+    }
+  } else {
+    Search(middle + 1, range_end, depth + 1, state);
+    if (offset <= state.max_chord) {
+      Search(range_begin, middle, depth + 1, state);
+    }
+  }
+}
+
+vector<SpatialIndex::Item> SpatialIndex::FindNearest(Sphere::Point center, size_t max_count, double max_distance) const {
+  if (max_count == 0 || max_distance < 0) {
+    return {};
+  }
+  SearchState state{
+      .center = Sphere::UnitVector::FromPoint(center),
+      .max_count = max_count,
+      // Chords of far points may exceed 2 a bit, so no limit means no limit on chords either
+      .max_chord = isinf(max_distance) ? max_distance : Sphere::ConvertDistanceToChord(max_distance),
+      .nearest = {},
+  };
+  Search(0, node_ids_.size(), 0, state);
+
+  sort_heap(begin(state.nearest), end(state.nearest));
+  vector<Item> items;
+  items.reserve(state.nearest.size());
+  for (const auto& [chord, id] : state.nearest) {
+    items.push_back({id, Sphere::ConvertChordToDistance(chord)});
+  }
+  return items;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "name_interner.h"
+#include "snapshot.h"
+#include "sphere.h"
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Static k-d tree of points on the sphere, by their unit vectors.
+// Nodes are kept in one array: the middle node of a range splits the rest of it
+// by one of the coordinates, which are taken in turn with depth.
+class SpatialIndex {
+public:
+  struct Item {
+    NameId id;
+    double distance;  // meters
+  };
+
+  SpatialIndex() = default;
+  // Ids of the points are their indices
+  explicit SpatialIndex(const std::vector<Sphere::Point>& points);
+  // Index written by Serialize, viewed in the mapping of the reader
+  explicit SpatialIndex(Snapshot::Reader& reader);
+
+  void Serialize(Snapshot::Writer& writer) const;
+
+  // At most max_count points not farther than max_distance from the center, nearest first.
+  // Ties are broken by smaller ids.
+  std::vector<Item> FindNearest(Sphere::Point center,
+                                size_t max_count = std::numeric_limits<size_t>::max(),
+                                double max_distance = std::numeric_limits<double>::infinity()) const;
+
+  size_t size() const {
+    return node_ids_.size();
+  }
+
+private:
+  struct Node {
+    Sphere::UnitVector vector;
+    NameId id;
+  };
+
+  // Fields of the nodes, apart so that snapshots get no padding of Node
+  Snapshot::Array<Sphere::UnitVector> node_vectors_;
+  Snapshot::Array<NameId> node_ids_;
+
+  struct SearchState {
+    Sphere::UnitVector center;
+    size_t max_count;
+    double max_chord;  // shrinks to the farthest of the nearest once max_count are found
+    std::vector<std::pair<double, NameId>> nearest;  // max-heap of chords
+
+    void Add(Sphere::UnitVector vector, NameId id);
+  };
+
+  static void Build(std::vector<Node>& nodes, size_t range_begin, size_t range_end, size_t depth);
+  void Search(size_t range_begin, size_t range_end, size_t depth, SearchState& state) const;
+};
@@ -1,5 +1,7 @@
 #include "sphere.h"
 
+#include <algorithm>
+
 using namespace std;
 
 namespace Sphere {
@@ -26,4 +28,25 @@ namespace Sphere {
       + cos(lhs.latitude) * cos(rhs.latitude) * cos(abs(lhs.longitude - rhs.longitude))
     ) * EARTH_RADIUS;
   }
+
+  UnitVector UnitVector::FromPoint(Point point) {
+    point = Point::FromDegrees(point.latitude, point.longitude);
+    return {
+      cos(point.latitude) * cos(point.longitude),
+      cos(point.latitude) * sin(point.longitude),
+      sin(point.latitude)
+    };
+  }
+
+  double ComputeChordLength(UnitVector lhs, UnitVector rhs) {
+    return hypot(lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z);
+  }
+
+  double ConvertChordToDistance(double chord) {
+    return 2 * asin(min(1.0, chord / 2)) * EARTH_RADIUS;
+  }
+
+  double ConvertDistanceToChord(double distance) {
+    return 2 * sin(min(PI / 2, distance / EARTH_RADIUS / 2));
+  }
 }
@@ -13,4 +13,19 @@ namespace Sphere {
   };
 
   double Distance(Point lhs, Point rhs);
+
+  // Point of the unit sphere in 3D. The chord between two of them grows with
+  // the Distance between their points, so nearest points can be found by chords.
+  struct UnitVector {
+    double x;
+    double y;
+    double z;
+
+    static UnitVector FromPoint(Point point);
+  };
+
+  double ComputeChordLength(UnitVector lhs, UnitVector rhs);
+  // Distance of points whose vectors are chord apart, and back
+  double ConvertChordToDistance(double chord);
+  double ConvertDistanceToChord(double distance);
 }
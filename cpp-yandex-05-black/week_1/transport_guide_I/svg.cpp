@@ -1,35 +1,99 @@
 #include "svg.h"
 
+#include <charconv>
+#include <iterator>
+#include <tuple>
+
 using namespace std;
 
 namespace Svg {
 
-  void RenderColor(ostream& out, monostate) {
+  template <typename Number, typename... FormatArgs>
+  static void AppendNumber(string& output, Number value, FormatArgs... format_args) {
+    char buffer[32];
+    const auto result = to_chars(begin(buffer), end(buffer), value, format_args...);
+    output.append(buffer, result.ptr);
+  }
+
+  Writer& Writer::operator<<(int value) {
+    AppendNumber(output_, value);
+    return *this;
+  }
+
+  Writer& Writer::operator<<(uint32_t value) {
+    AppendNumber(output_, value);
+    return *this;
+  }
+
+  // Same text as the default stream formatting (%g with precision 6), but locale-free
+  Writer& Writer::operator<<(double value) {
+    AppendNumber(output_, value, chars_format::general, 6);
+    return *this;
+  }
+
+  bool operator<(Point lhs, Point rhs) {
+    return tie(lhs.x, lhs.y) < tie(rhs.x, rhs.y);
+  }
+
+  bool operator<(Rgb lhs, Rgb rhs) {
+    return tie(lhs.red, lhs.green, lhs.blue) < tie(rhs.red, rhs.green, rhs.blue);
+  }
+
+  bool operator<(Rgba lhs, Rgba rhs) {
+    return tie(lhs.red, lhs.green, lhs.blue, lhs.opacity) < tie(rhs.red, rhs.green, rhs.blue, rhs.opacity);
+  }
+
+  bool operator==(const ViewBox& lhs, const ViewBox& rhs) {
+    return tie(lhs.min.x, lhs.min.y, lhs.width, lhs.height) == tie(rhs.min.x, rhs.min.y, rhs.width, rhs.height);
+  }
+
+  void RenderColor(Writer& out, monostate) {
     out << "none";
   }
 
-  void RenderColor(ostream& out, const string& value) {
+  void RenderColor(Writer& out, const string& value) {
     out << value;
   }
 
-  void RenderColor(ostream& out, Rgb rgb) {
+  void RenderColor(Writer& out, Rgb rgb) {
     out << "rgb(" << static_cast<int>(rgb.red)
         << "," << static_cast<int>(rgb.green)
         << "," << static_cast<int>(rgb.blue) << ")";
   }
 
-  void RenderColor(ostream& out, Rgba rgba) {
+  void RenderColor(Writer& out, Rgba rgba) {
     out << "rgba(" << static_cast<int>(rgba.red)
         << "," << static_cast<int>(rgba.green)
         << "," << static_cast<int>(rgba.blue)
         << "," << rgba.opacity << ")";
   }
 
-  void RenderColor(ostream& out, const Color& color) {
+  void RenderColor(Writer& out, const Color& color) {
     visit([&out](const auto& value) { RenderColor(out, value); },
           color);
   }
 
+  void PathAttrs::Render(Writer& out) const {
+    out << "fill=\"";
+    RenderColor(out, fill_color);
+    out << "\" ";
+    out << "stroke=\"";
+    RenderColor(out, stroke_color);
+    out << "\" ";
+    out << "stroke-width=\"" << stroke_width << "\" ";
+    if (stroke_line_cap) {
+        out << "stroke-linecap=\"" << *stroke_line_cap << "\" ";
+    }
+    if (stroke_line_join) {
+        out << "stroke-linejoin=\"" << *stroke_line_join << "\" ";
+    }
+  }
+
+  bool operator<(const PathAttrs& lhs, const PathAttrs& rhs) {
+    return tie(lhs.fill_color, lhs.stroke_color, lhs.stroke_width, lhs.stroke_line_cap, lhs.stroke_line_join)
+        < tie(rhs.fill_color, rhs.stroke_color, rhs.stroke_width, rhs.stroke_line_cap, rhs.stroke_line_join);
+  }
+
   Circle& Circle::SetCenter(Point point) {
     center_ = point;
     return *this;
@@ -39,31 +103,11 @@ namespace Svg {
     return *this;
   }
 
-  void Circle::Render(ostream& out) const {
-    out << "<circle ";
-    out << "cx=\"" << center_.x << "\" ";
-    out << "cy=\"" << center_.y << "\" ";
-    out << "r=\"" << radius_ << "\" ";
-    PathProps::RenderAttrs(out);
-    out << "/>";
-  }
-
   Polyline& Polyline::AddPoint(Point point) {
     points_.push_back(point);
     return *this;
   }
 
-  void Polyline::Render(ostream& out) const {
-    out << "<polyline ";
-    out << "points=\"";
-    for (const Point point : points_) {
-      out << point.x << "," << point.y << " ";
-    }
-    out << "\" ";
-    PathProps::RenderAttrs(out);
-    out << "/>";
-  }
-
   Text& Text::SetPoint(Point point) {
     point_ = point;
     return *this;
@@ -94,32 +138,124 @@ namespace Svg {
     return *this;
   }
 
-  void Text::Render(ostream& out) const {
-    out << "<text ";
-    out << "x=\"" << point_.x << "\" ";
-    out << "y=\"" << point_.y << "\" ";
-    out << "dx=\"" << offset_.x << "\" ";
-    out << "dy=\"" << offset_.y << "\" ";
-    out << "font-size=\"" << font_size_ << "\" ";
-    if (font_family_) {
-        out << "font-family=\"" << *font_family_ << "\" ";
+  template <typename AttrsIds, typename Key, typename RenderAttrs>
+  Document::AttrsId Document::InternAttrs(AttrsIds& attrs_ids, const Key& key, RenderAttrs render_attrs) {
+    if (auto it = attrs_ids.find(key); it != end(attrs_ids)) {
+      return it->second;
     }
-    if (font_weight_) {
-        out << "font-weight=\"" << *font_weight_ << "\" ";
+    Writer out(attrs_texts_.emplace_back());
+    render_attrs(out);
+    const AttrsId attrs_id = attrs_texts_.size() - 1;
+    attrs_ids.emplace(key, attrs_id);
+    return attrs_id;
+  }
+
+  void Document::Add(const Circle& circle) {
+    const auto attrs_key = tie(circle.radius_, circle.path_attrs_);
+    const AttrsId attrs_id = InternAttrs(circle_attrs_ids_, attrs_key, [&circle](Writer& out) {
+      out << "r=\"" << circle.radius_ << "\" ";
+      circle.path_attrs_.Render(out);
+    });
+    shapes_.push_back(CircleShape{circle.center_, attrs_id});
+  }
+
+  void Document::Add(const Polyline& polyline) {
+    const AttrsId attrs_id = InternAttrs(polyline_attrs_ids_, polyline.path_attrs_, [&polyline](Writer& out) {
+      polyline.path_attrs_.Render(out);
+    });
+    const size_t points_begin = points_.size();
+    points_.insert(end(points_), begin(polyline.points_), end(polyline.points_));
+    shapes_.push_back(PolylineShape{points_begin, points_.size(), attrs_id});
+  }
+
+  void Document::Add(const Text& text) {
+    const auto attrs_key = tie(text.offset_, text.font_size_, text.font_family_, text.font_weight_, text.path_attrs_);
+    const AttrsId attrs_id = InternAttrs(text_attrs_ids_, attrs_key, [&text](Writer& out) {
+      out << "dx=\"" << text.offset_.x << "\" ";
+      out << "dy=\"" << text.offset_.y << "\" ";
+      out << "font-size=\"" << text.font_size_ << "\" ";
+      if (text.font_family_) {
+          out << "font-family=\"" << *text.font_family_ << "\" ";
+      }
+      if (text.font_weight_) {
+          out << "font-weight=\"" << *text.font_weight_ << "\" ";
+      }
+      text.path_attrs_.Render(out);
+    });
+    const size_t data_begin = texts_.size();
+    texts_ += text.data_;
+    shapes_.push_back(TextShape{text.point_, data_begin, texts_.size(), attrs_id});
+  }
+
+  void Document::RenderShape(Writer& out, const CircleShape& circle) const {
+    out << "<circle ";
+    out << "cx=\"" << circle.center.x << "\" ";
+    out << "cy=\"" << circle.center.y << "\" ";
+    out << attrs_texts_[circle.attrs_id];
+    out << "/>";
+  }
+
+  void Document::RenderShape(Writer& out, const PolylineShape& polyline) const {
+    out << "<polyline ";
+    out << "points=\"";
+    for (size_t point_idx = polyline.points_begin; point_idx < polyline.points_end; ++point_idx) {
+      out << points_[point_idx].x << "," << points_[point_idx].y << " ";
     }
-    PathProps::RenderAttrs(out);
+    out << "\" ";
+    out << attrs_texts_[polyline.attrs_id];
+    out << "/>";
+  }
+
+  void Document::RenderShape(Writer& out, const TextShape& text) const {
+    out << "<text ";
+    out << "x=\"" << text.point.x << "\" ";
+    out << "y=\"" << text.point.y << "\" ";
+    out << attrs_texts_[text.attrs_id];
     out << ">";
-    out << data_;
+    out << string_view(texts_).substr(text.data_begin, text.data_end - text.data_begin);
     out << "</text>";
   }
 
-  void Document::Render(ostream& out) const {
+  void Document::RenderBegin(string& output, const optional<ViewBox>& view_box) {
+    Writer out(output);
     out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>";
-    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">";
-    for (const auto& object_ptr : objects_) {
-      object_ptr->Render(out);
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\"";
+    if (view_box) {
+      out << " viewBox=\"" << view_box->min.x << " " << view_box->min.y
+          << " " << view_box->width << " " << view_box->height << "\"";
+    }
+    out << ">";
+  }
+
+  void Document::RenderShapes(string& output) const {
+    Writer out(output);
+    for (const auto& shape : shapes_) {
+      visit([this, &out](const auto& shape) { RenderShape(out, shape); },
+            shape);
     }
+  }
+
+  void Document::RenderEnd(string& output) {
+    Writer out(output);
     out << "</svg>";
   }
 
+  void Document::Render(string& output) const {
+    RenderBegin(output);
+    RenderShapes(output);
+    RenderEnd(output);
+  }
+
+  void Document::Render(string& output, const ViewBox& view_box) const {
+    RenderBegin(output, view_box);
+    RenderShapes(output);
+    RenderEnd(output);
+  }
+
+  void Document::Render(ostream& out) const {
+    string output;
+    Render(output);
+    out << output;
+  }
+
 }
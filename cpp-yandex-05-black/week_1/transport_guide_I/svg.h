@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
-#include <memory>
+#include <map>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -15,6 +18,8 @@ namespace Svg {
     double y = 0;
   };
 
+  bool operator<(Point lhs, Point rhs);
+
   struct Rgb {
     uint8_t red;
     uint8_t green;
@@ -25,17 +30,56 @@ namespace Svg {
     double opacity;
   };
 
+  bool operator<(Rgb lhs, Rgb rhs);
+  bool operator<(Rgba lhs, Rgba rhs);
+
   using Color = std::variant<std::monostate, std::string, Rgb, Rgba>;
   const Color NoneColor{};
 
-  void RenderColor(std::ostream& os, const Color& color);
+  // Region of the picture to show, in the coordinates of its shapes
+  struct ViewBox {
+    Point min;
+    double width = 0;
+    double height = 0;
+  };
+
+  bool operator==(const ViewBox& lhs, const ViewBox& rhs);
 
-  class Object {
+  // Appends text to a string buffer, numbers are formatted as by the default ostream
+  class Writer {
   public:
-    virtual void Render(std::ostream& out) const = 0;
-    virtual ~Object() = default;
+    explicit Writer(std::string& output) : output_(output) {}
+
+    Writer& operator<<(std::string_view value) {
+      output_ += value;
+      return *this;
+    }
+    Writer& operator<<(const char* value) {
+      return *this << std::string_view(value);
+    }
+    Writer& operator<<(int value);
+    Writer& operator<<(uint32_t value);
+    Writer& operator<<(double value);
+
+  private:
+    std::string& output_;
+  };
+
+  void RenderColor(Writer& out, const Color& color);
+
+  // Attributes common to all shapes
+  struct PathAttrs {
+    Color fill_color;
+    Color stroke_color;
+    double stroke_width = 1.0;
+    std::optional<std::string> stroke_line_cap;
+    std::optional<std::string> stroke_line_join;
+
+    void Render(Writer& out) const;
   };
 
+  bool operator<(const PathAttrs& lhs, const PathAttrs& rhs);
+
   template <typename Owner>
   class PathProps {
   public:
@@ -44,40 +88,37 @@ namespace Svg {
     Owner& SetStrokeWidth(double value);
     Owner& SetStrokeLineCap(const std::string& value);
     Owner& SetStrokeLineJoin(const std::string& value);
-    void RenderAttrs(std::ostream& out) const;
 
   protected:
-    Color fill_color_;
-    Color stroke_color_;
-    double stroke_width_ = 1.0;
-    std::optional<std::string> stroke_line_cap_;
-    std::optional<std::string> stroke_line_join_;
+    PathAttrs path_attrs_;
 
   private:
     Owner& AsOwner();
   };
 
-  class Circle : public Object, public PathProps<Circle> {
+  class Circle : public PathProps<Circle> {
   public:
     Circle& SetCenter(Point point);
     Circle& SetRadius(double radius);
-    void Render(std::ostream& out) const override;
 
   private:
+    friend class Document;
+
     Point center_;
     double radius_ = 1;
   };
 
-  class Polyline : public Object, public PathProps<Polyline> {
+  class Polyline : public PathProps<Polyline> {
   public:
     Polyline& AddPoint(Point point);
-    void Render(std::ostream& out) const override;
 
   private:
+    friend class Document;
+
     std::vector<Point> points_;
   };
 
-  class Text : public Object, public PathProps<Text> {
+  class Text : public PathProps<Text> {
   public:
     Text& SetPoint(Point point);
     Text& SetOffset(Point point);
@@ -85,9 +126,10 @@ namespace Svg {
     Text& SetFontFamily(const std::string& value);
     Text& SetFontWeight(const std::string& value);
     Text& SetData(const std::string& data);
-    void Render(std::ostream& out) const override;
 
   private:
+    friend class Document;
+
     Point point_;
     Point offset_;
     uint32_t font_size_ = 1;
@@ -96,15 +138,64 @@ namespace Svg {
     std::string data_;
   };
 
-  class Document : public Object {
+  // Shapes are kept in one array of plain records, in the order of adding.
+  // Points and texts of all shapes are pooled in two more arrays,
+  // and the rendered attributes, which are the same for most shapes of a layer, are stored once.
+  class Document {
   public:
-    template <typename ObjectType>
-    void Add(ObjectType object);
+    void Add(const Circle& circle);
+    void Add(const Polyline& polyline);
+    void Add(const Text& text);
 
-    void Render(std::ostream& out) const override;
+    void Render(std::string& out) const;
+    void Render(std::ostream& out) const;
+    void Render(std::string& out, const ViewBox& view_box) const;
+
+    // A picture may be made of documents rendered separately:
+    // RenderBegin, then the shapes of each document in order, then RenderEnd
+    static void RenderBegin(std::string& out, const std::optional<ViewBox>& view_box = std::nullopt);
+    void RenderShapes(std::string& out) const;
+    static void RenderEnd(std::string& out);
 
   private:
-    std::vector<std::unique_ptr<Object>> objects_;
+    using AttrsId = uint32_t;
+
+    struct CircleShape {
+      Point center;
+      AttrsId attrs_id;  // radius and path attributes
+    };
+
+    struct PolylineShape {
+      size_t points_begin;
+      size_t points_end;
+      AttrsId attrs_id;
+    };
+
+    struct TextShape {
+      Point point;
+      size_t data_begin;
+      size_t data_end;
+      AttrsId attrs_id;  // offset, font and path attributes
+    };
+
+    std::vector<std::variant<CircleShape, PolylineShape, TextShape>> shapes_;
+    std::vector<Point> points_;
+    std::string texts_;
+    std::vector<std::string> attrs_texts_;
+
+    // Ids of attributes rendered so far, by their values
+    using CircleAttrs = std::tuple<double, PathAttrs>;
+    using TextAttrs = std::tuple<Point, uint32_t, std::optional<std::string>, std::optional<std::string>, PathAttrs>;
+    std::map<CircleAttrs, AttrsId, std::less<>> circle_attrs_ids_;
+    std::map<PathAttrs, AttrsId> polyline_attrs_ids_;
+    std::map<TextAttrs, AttrsId, std::less<>> text_attrs_ids_;
+
+    template <typename AttrsIds, typename Key, typename RenderAttrs>
+    AttrsId InternAttrs(AttrsIds& attrs_ids, const Key& key, RenderAttrs render_attrs);
+
+    void RenderShape(Writer& out, const CircleShape& circle) const;
+    void RenderShape(Writer& out, const PolylineShape& polyline) const;
+    void RenderShape(Writer& out, const TextShape& text) const;
   };
 
 
@@ -115,54 +206,32 @@ namespace Svg {
 
   template <typename Owner>
   Owner& PathProps<Owner>::SetFillColor(const Color& color) {
-    fill_color_ = color;
+    path_attrs_.fill_color = color;
     return AsOwner();
   }
 
   template <typename Owner>
   Owner& PathProps<Owner>::SetStrokeColor(const Color& color) {
-    stroke_color_ = color;
+    path_attrs_.stroke_color = color;
     return AsOwner();
   }
 
   template <typename Owner>
   Owner& PathProps<Owner>::SetStrokeWidth(double value) {
-    stroke_width_ = value;
+    path_attrs_.stroke_width = value;
     return AsOwner();
   }
 
   template <typename Owner>
   Owner& PathProps<Owner>::SetStrokeLineCap(const std::string& value) {
-    stroke_line_cap_ = value;
+    path_attrs_.stroke_line_cap = value;
     return AsOwner();
   }
 
   template <typename Owner>
   Owner& PathProps<Owner>::SetStrokeLineJoin(const std::string& value) {
-    stroke_line_join_ = value;
+    path_attrs_.stroke_line_join = value;
     return AsOwner();
   }
 
-  template <typename Owner>
-  void PathProps<Owner>::RenderAttrs(std::ostream& out) const {
-    out << "fill=\"";
-    RenderColor(out, fill_color_);
-    out << "\" ";
-    out << "stroke=\"";
-    RenderColor(out, stroke_color_);
-    out << "\" ";
-    out << "stroke-width=\"" << stroke_width_ << "\" ";
-    if (stroke_line_cap_) {
-        out << "stroke-linecap=\"" << *stroke_line_cap_ << "\" ";
-    }
-    if (stroke_line_join_) {
-        out << "stroke-linejoin=\"" << *stroke_line_join_ << "\" ";
-    }
-  }
-
-  template <typename ObjectType>
-  void Document::Add(ObjectType object) {
-    objects_.push_back(std::make_unique<ObjectType>(std::move(object)));
-  }
-
 }
@@ -1,103 +1,373 @@
 #include "transport_catalog.h"
-#include "map_renderer.h"
 #include "utils.h"
 
 #include <algorithm>
 #include <iterator>
 #include <map>
 #include <optional>
-#include <sstream>
-#include <unordered_map>
+#include <thread>
 
 using namespace std;
 
+// Threads building parts of the map and then rendering them
+static const size_t MAP_THREAD_COUNT = max<size_t>(1, thread::hardware_concurrency());
+
 TransportCatalog::TransportCatalog(
     vector<Descriptions::InputQuery> data,
     const Json::Dict& routing_settings_json,
     const Json::Dict& render_settings_json
-) {
+) : route_cache_(ParseRouteCacheSize(routing_settings_json)),
+    tile_cache_(ParseTileCacheSize(render_settings_json)) {
   auto stops_end = partition(begin(data), end(data), [](const auto& item) {
     return holds_alternative<Descriptions::Stop>(item);
   });
 
   Descriptions::StopsDict stops_dict;
+  vector<Sphere::Point> stop_positions;
   for (const auto& item : Range{begin(data), stops_end}) {
     const auto& stop = get<Descriptions::Stop>(item);
     stops_dict[stop.name] = &stop;
-    stops_.insert({stop.name, {}});
+    const NameId stop_id = stop_names_.Intern(stop.name);
+    stop_positions.resize(stop_names_.size());
+    stop_positions[stop_id] = stop.position;
   }
+  stops_index_ = SpatialIndex(stop_positions);
 
+  const RoadDistances road_distances(stops_dict, stop_names_);
   Descriptions::BusesDict buses_dict;
+  vector<BusRoadRoute> bus_routes;
+  vector<vector<NameId>> stops_bus_ids(stop_names_.size());
   for (const auto& item : Range{stops_end, end(data)}) {
     const auto& bus = get<Descriptions::Bus>(item);
 
     buses_dict[bus.name] = &bus;
-    buses_[bus.name] = Bus{
-      bus.stops.size(),
-      ComputeUniqueItemsCount(AsRange(bus.stops)),
-      ComputeRoadRouteLength(bus.stops, stops_dict),
-      ComputeGeoRouteDistance(bus.stops, stops_dict)
+    const NameId bus_id = bus_names_.Intern(bus.name);
+    vector<NameId> stop_ids;
+    stop_ids.reserve(bus.stops.size());
+    for (const string& stop_name : bus.stops) {
+      stop_ids.push_back(stop_names_.GetId(stop_name));
+    }
+    bus_routes.resize(bus_names_.size());
+    const BusRoadRoute& route = bus_routes[bus_id] = BusRoadRoute(move(stop_ids), road_distances);
+
+    buses_.resize(bus_names_.size());
+    buses_[bus_id] = Bus{
+      route.stop_ids.size(),
+      ComputeUniqueItemsCount(AsRange(route.stop_ids)),
+      route.GetLength(),
+      ComputeGeoRouteDistance(route.stop_ids, stop_positions)
     };
 
-    for (const string& stop_name : bus.stops) {
-      stops_.at(stop_name).bus_names.insert(bus.name);
+    for (const NameId stop_id : route.stop_ids) {
+      stops_bus_ids[stop_id].push_back(bus_id);
     }
   }
+  auto& stop_bus_offsets = stop_bus_offsets_.Edit();
+  auto& stop_bus_ids = stop_bus_ids_.Edit();
+  stop_bus_offsets.reserve(stops_bus_ids.size() + 1);
+  stop_bus_offsets.push_back(0);
+  for (vector<NameId>& bus_ids : stops_bus_ids) {
+    sort(begin(bus_ids), end(bus_ids), [this](NameId lhs, NameId rhs) {
+      return bus_names_.GetName(lhs) < bus_names_.GetName(rhs);
+    });
+    stop_bus_ids.insert(end(stop_bus_ids), begin(bus_ids), unique(begin(bus_ids), end(bus_ids)));
+    stop_bus_offsets.push_back(stop_bus_ids.size());
+  }
+
+  router_ = MakeRouter(stops_dict, buses_dict, bus_routes, routing_settings_json);
+
+  stop_responses_ = vector<CachedResponse>(stop_names_.size());
+  bus_responses_ = vector<CachedResponse>(buses_.size());
+
+  map_renderer_.emplace(stops_dict, buses_dict, render_settings_json);
+  map_parts_ = map_renderer_->Render(MAP_THREAD_COUNT);
+}
+
+TransportCatalog::TransportCatalog(unique_ptr<Snapshot::Reader> snapshot)
+    : snapshot_(move(snapshot)),
+      stop_names_(*snapshot_),
+      bus_names_(*snapshot_),
+      stop_bus_offsets_(snapshot_->ReadMappedArray<size_t>()),
+      stop_bus_ids_(snapshot_->ReadMappedArray<NameId>()),
+      stops_index_(*snapshot_),
+      route_cache_(snapshot_->ReadValue<size_t>()),
+      tile_cache_(snapshot_->ReadValue<size_t>())
+{
+  if (stop_bus_offsets_.size() != stop_names_.size() + 1 || stop_bus_offsets_[0] != 0
+      || !is_sorted(begin(stop_bus_offsets_), end(stop_bus_offsets_))
+      || stop_bus_offsets_.back() != stop_bus_ids_.size()) {
+    throw Snapshot::FormatError("malformed stops");
+  }
+  if (stops_index_.size() != stop_names_.size()) {
+    throw Snapshot::FormatError("malformed stops index");
+  }
+
+  LoadBuses(*snapshot_);
+  router_ = LoadRouter(*snapshot_);
+
+  stop_responses_ = vector<CachedResponse>(stop_names_.size());
+  bus_responses_ = vector<CachedResponse>(buses_.size());
+
+  map_ = snapshot_->ReadString();
+  map_renderer_.emplace(*snapshot_);
+}
+
+void TransportCatalog::Serialize(Snapshot::Writer& writer) const {
+  stop_names_.Serialize(writer);
+  bus_names_.Serialize(writer);
+  writer.WriteArray(stop_bus_offsets_);
+  writer.WriteArray(stop_bus_ids_);
+  stops_index_.Serialize(writer);
+  writer.WriteValue(route_cache_.GetMaxSize());
+  writer.WriteValue(tile_cache_.GetMaxSize());
+
+  SerializeBuses(writer);
+
+  writer.WriteValue(router_.index());
+  visit([&writer](const auto& router) { router->Serialize(writer); }, router_);
+
+  writer.WriteString(RenderMap());
+  map_renderer_->Serialize(writer);
+}
+
+void TransportCatalog::SerializeBuses(Snapshot::Writer& writer) const {
+  vector<size_t> stop_counts;
+  vector<size_t> unique_stop_counts;
+  vector<int> road_route_lengths;
+  vector<double> geo_route_lengths;
+  for (const Bus& bus : buses_) {
+    stop_counts.push_back(bus.stop_count);
+    unique_stop_counts.push_back(bus.unique_stop_count);
+    road_route_lengths.push_back(bus.road_route_length);
+    geo_route_lengths.push_back(bus.geo_route_length);
+  }
+  writer.WriteArray(stop_counts);
+  writer.WriteArray(unique_stop_counts);
+  writer.WriteArray(road_route_lengths);
+  writer.WriteArray(geo_route_lengths);
+}
 
-  router_ = make_unique<TransportRouter>(stops_dict, buses_dict, routing_settings_json);
+void TransportCatalog::LoadBuses(Snapshot::Reader& reader) {
+  const auto stop_counts = reader.ReadArray<size_t>();
+  const auto unique_stop_counts = reader.ReadArray<size_t>();
+  const auto road_route_lengths = reader.ReadArray<int>();
+  const auto geo_route_lengths = reader.ReadArray<double>();
+  const size_t bus_count = bus_names_.size();
+  if (stop_counts.size() != bus_count || unique_stop_counts.size() != bus_count
+      || road_route_lengths.size() != bus_count || geo_route_lengths.size() != bus_count) {
+    throw Snapshot::FormatError("malformed buses");
+  }
+  buses_.reserve(bus_count);
+  for (size_t bus_id = 0; bus_id < bus_count; ++bus_id) {
+    buses_.push_back({
+        stop_counts.begin()[bus_id],
+        unique_stop_counts.begin()[bus_id],
+        road_route_lengths.begin()[bus_id],
+        geo_route_lengths.begin()[bus_id],
+    });
+  }
+}
 
-  map_ = BuildMap(stops_dict, buses_dict, render_settings_json);
+TransportCatalog::Stop TransportCatalog::MakeStop(NameId stop_id) const {
+  return {{stop_bus_ids_.data() + stop_bus_offsets_[stop_id], stop_bus_ids_.data() + stop_bus_offsets_[stop_id + 1]}};
 }
 
-const TransportCatalog::Stop* TransportCatalog::GetStop(const string& name) const {
-  return GetValuePointer(stops_, name);
+optional<TransportCatalog::Stop> TransportCatalog::GetStop(string_view name) const {
+  const auto stop_id = stop_names_.Find(name);
+  if (!stop_id) {
+    return nullopt;
+  }
+  return MakeStop(*stop_id);
 }
 
-const TransportCatalog::Bus* TransportCatalog::GetBus(const string& name) const {
-  return GetValuePointer(buses_, name);
+const TransportCatalog::Bus* TransportCatalog::GetBus(string_view name) const {
+  const auto bus_id = bus_names_.Find(name);
+  return bus_id ? &buses_[*bus_id] : nullptr;
 }
 
-optional<TransportRouter::RouteInfo> TransportCatalog::FindRoute(const string& stop_from, const string& stop_to) const {
-  return router_->FindRoute(stop_from, stop_to);
+TransportCatalog::RouteInfoPtr TransportCatalog::FindRoute(string_view stop_from, string_view stop_to) const {
+  const pair stop_ids{stop_names_.GetId(stop_from), stop_names_.GetId(stop_to)};
+  return route_cache_.GetOrCompute(stop_ids, [this, &stop_ids]() -> RouteInfoPtr {
+    auto route = visit([&stop_ids](const auto& router) {
+                         return router->FindRoute(stop_ids.first, stop_ids.second);
+                       },
+                       router_);
+    if (!route) {
+      return nullptr;
+    }
+    return make_shared<const TransportRouter::RouteInfo>(move(*route));
+  });
 }
 
-string TransportCatalog::RenderMap() const {
-  ostringstream out;
-  map_.Render(out);
-  return out.str();
+LruCacheStats TransportCatalog::GetRouteCacheStats() const {
+  return route_cache_.GetStats();
 }
 
-int TransportCatalog::ComputeRoadRouteLength(
-    const vector<string>& stops,
-    const Descriptions::StopsDict& stops_dict
-) {
-  int result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
-    result += Descriptions::ComputeStopsDistance(*stops_dict.at(stops[i - 1]), *stops_dict.at(stops[i]));
+LruCacheStats TransportCatalog::GetTileCacheStats() const {
+  return tile_cache_.GetStats();
+}
+
+const Json::PrintedValue* TransportCatalog::GetStopResponse(string_view name) const {
+  const auto stop_id = stop_names_.Find(name);
+  if (!stop_id) {
+    return nullptr;
   }
-  return result;
+  CachedResponse& cached = stop_responses_[*stop_id];
+  call_once(cached.once, [this, &cached, stop_id] {
+    cached.response = PrintStopResponse(MakeStop(*stop_id));
+  });
+  return &cached.response;
+}
+
+const Json::PrintedValue* TransportCatalog::GetBusResponse(string_view name) const {
+  const auto bus_id = bus_names_.Find(name);
+  if (!bus_id) {
+    return nullptr;
+  }
+  CachedResponse& cached = bus_responses_[*bus_id];
+  call_once(cached.once, [&cached, &bus = buses_[*bus_id]] {
+    cached.response = PrintBusResponse(bus);
+  });
+  return &cached.response;
+}
+
+// Keys are sorted, as in responses printed from Json::Dict
+Json::PrintedValue TransportCatalog::PrintStopResponse(const Stop& stop) const {
+  string text;
+  Json::Writer writer(text);
+  writer.StartObject();
+  writer.Key("buses").StartArray();
+  for (const NameId bus_id : stop.bus_ids) {
+    writer.Value(bus_names_.GetName(bus_id));
+  }
+  writer.EndArray();
+  writer.Key("request_id").RawValue("");
+  const size_t request_id_pos = text.size();
+  writer.EndObject();
+  return {text.substr(0, request_id_pos), text.substr(request_id_pos)};
+}
+
+Json::PrintedValue TransportCatalog::PrintBusResponse(const Bus& bus) {
+  string text;
+  Json::Writer writer(text);
+  writer.StartObject();
+  writer.Key("curvature").Value(bus.road_route_length / bus.geo_route_length);
+  writer.Key("request_id").RawValue("");
+  const size_t request_id_pos = text.size();
+  writer.Key("route_length").Value(bus.road_route_length);
+  writer.Key("stop_count").Value(static_cast<int>(bus.stop_count));
+  writer.Key("unique_stop_count").Value(static_cast<int>(bus.unique_stop_count));
+  writer.EndObject();
+  return {text.substr(0, request_id_pos), text.substr(request_id_pos)};
+}
+
+vector<SpatialIndex::Item> TransportCatalog::FindNearestStops(Sphere::Point point, size_t max_count,
+                                                              double max_distance) const {
+  return stops_index_.FindNearest(point, max_count, max_distance);
+}
+
+string_view TransportCatalog::GetStopName(NameId stop_id) const {
+  return stop_names_.GetName(stop_id);
+}
+
+string_view TransportCatalog::GetBusName(NameId bus_id) const {
+  return bus_names_.GetName(bus_id);
+}
+
+size_t TransportCatalog::ParseRouteCacheSize(const Json::Dict& routing_settings_json) {
+  if (routing_settings_json.count("route_cache_size") == 0) {
+    return 0;
+  }
+  return max(0, routing_settings_json.at("route_cache_size").AsInt());
+}
+
+size_t TransportCatalog::ParseTileCacheSize(const Json::Dict& render_settings_json) {
+  static constexpr size_t DEFAULT_TILE_CACHE_SIZE = 64;
+
+  if (render_settings_json.count("tile_cache_size") == 0) {
+    return DEFAULT_TILE_CACHE_SIZE;
+  }
+  return max(0, render_settings_json.at("tile_cache_size").AsInt());
+}
+
+void TransportCatalog::RenderMapOnce() const {
+  call_once(map_once_, [this] {
+    if (map_.empty()) {
+      // Each thread renders the parts it has built, one of every layer
+      vector<string> part_buffers(map_parts_.size());
+      ParallelFor(MAP_THREAD_COUNT, [this, &part_buffers](size_t thread_idx) {
+        for (size_t part_idx = thread_idx; part_idx < map_parts_.size(); part_idx += MAP_THREAD_COUNT) {
+          map_parts_[part_idx].RenderShapes(part_buffers[part_idx]);
+        }
+      }, MAP_THREAD_COUNT);
+      Svg::Document::RenderBegin(map_);
+      for (const string& buffer : part_buffers) {
+        map_ += buffer;
+      }
+      Svg::Document::RenderEnd(map_);
+      map_parts_ = {};
+    }
+    Json::Writer(map_json_).Value(map_);
+  });
+}
+
+const string& TransportCatalog::RenderMap() const {
+  RenderMapOnce();
+  return map_;
+}
+
+const string& TransportCatalog::RenderMapJson() const {
+  RenderMapOnce();
+  return map_json_;
+}
+
+TransportCatalog::MapTilePtr TransportCatalog::RenderMapTile(const Svg::ViewBox& viewport) const {
+  return tile_cache_.GetOrCompute(viewport, [this, &viewport] {
+    string svg;
+    map_renderer_->RenderViewport(viewport).Render(svg, viewport);
+    MapTile tile;
+    Json::Writer(tile.svg_json).Value(svg);
+    return make_shared<const MapTile>(move(tile));
+  });
+}
+
+optional<Svg::ViewBox> TransportCatalog::GetMapTileViewport(int zoom, int x, int y) const {
+  return map_renderer_->GetTileViewport(zoom, x, y);
 }
 
 double TransportCatalog::ComputeGeoRouteDistance(
-    const vector<string>& stops,
-    const Descriptions::StopsDict& stops_dict
+    const vector<NameId>& stop_ids,
+    const vector<Sphere::Point>& stop_positions
 ) {
   double result = 0;
-  for (size_t i = 1; i < stops.size(); ++i) {
+  for (size_t i = 1; i < stop_ids.size(); ++i) {
     result += Sphere::Distance(
-      stops_dict.at(stops[i - 1])->position, stops_dict.at(stops[i])->position
+      stop_positions[stop_ids[i - 1]], stop_positions[stop_ids[i]]
     );
   }
   return result;
 }
 
-
-Svg::Document TransportCatalog::BuildMap(const Descriptions::StopsDict& stops_dict,
-                                         const Descriptions::BusesDict& buses_dict,
-                                         const Json::Dict& render_settings_json) {
-  if (stops_dict.empty()) {
-    return {};
+TransportCatalog::Router TransportCatalog::MakeRouter(const Descriptions::StopsDict& stops_dict,
+                                                      const Descriptions::BusesDict& buses_dict,
+                                                      const vector<BusRoadRoute>& bus_routes,
+                                                      const Json::Dict& routing_settings_json) const {
+  // RAPTOR scans bus stop arrays directly, so it skips building the graph
+  if (TransportRouter::ParseRouterEngine(routing_settings_json) == TransportRouter::RouterEngine::RAPTOR) {
+    return make_unique<RaptorRouter>(buses_dict, routing_settings_json, stop_names_, bus_names_, bus_routes);
   }
-  return MapRenderer(stops_dict, buses_dict, render_settings_json).Render();
+  return make_unique<TransportRouter>(stops_dict, buses_dict, routing_settings_json,
+                                      stop_names_, bus_names_, bus_routes);
 }
 
+TransportCatalog::Router TransportCatalog::LoadRouter(Snapshot::Reader& reader) {
+  // Alternative index of Router
+  switch (reader.ReadValue<size_t>()) {
+    case 0:
+      return make_unique<TransportRouter>(reader);
+    case 1:
+      return make_unique<RaptorRouter>(reader);
+    default:
+      throw Snapshot::FormatError("unknown router");
+  }
+}
@@ -2,20 +2,30 @@
 
 #include "descriptions.h"
 #include "json.h"
+#include "lru_cache.h"
+#include "map_renderer.h"
+#include "name_interner.h"
+#include "raptor_router.h"
+#include "road_distances.h"
+#include "snapshot.h"
+#include "spatial_index.h"
+#include "sphere.h"
 #include "svg.h"
 #include "transport_router.h"
 #include "utils.h"
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <set>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 namespace Responses {
   struct Stop {
-    std::set<std::string> bus_names;
+    Range<const NameId*> bus_ids;  // unique, sorted by bus names
   };
 
   struct Bus {
@@ -30,6 +40,7 @@ class TransportCatalog {
 private:
   using Bus = Responses::Bus;
   using Stop = Responses::Stop;
+  using Router = std::variant<std::unique_ptr<TransportRouter>, std::unique_ptr<RaptorRouter>>;
 
 public:
   TransportCatalog(
@@ -37,33 +48,121 @@ public:
       const Json::Dict& routing_settings_json,
       const Json::Dict& render_settings_json
   );
+  // Catalog written by Serialize, ready without rebuilding the router or the map.
+  // Its arrays are viewed right in the mapped snapshot, which the catalog keeps.
+  explicit TransportCatalog(std::unique_ptr<Snapshot::Reader> snapshot);
 
-  const Stop* GetStop(const std::string& name) const;
-  const Bus* GetBus(const std::string& name) const;
+  void Serialize(Snapshot::Writer& writer) const;
 
-  std::optional<TransportRouter::RouteInfo> FindRoute(const std::string& stop_from, const std::string& stop_to) const;
+  // Lookups by name don't allocate
+  std::optional<Stop> GetStop(std::string_view name) const;
+  const Bus* GetBus(std::string_view name) const;
 
-  std::string RenderMap() const;
+  using RouteInfoPtr = std::shared_ptr<const TransportRouter::RouteInfo>;
+  // Null if there is no route
+  RouteInfoPtr FindRoute(std::string_view stop_from, std::string_view stop_to) const;
 
-private:
-  static int ComputeRoadRouteLength(
-      const std::vector<std::string>& stops,
-      const Descriptions::StopsDict& stops_dict
-  );
+  // Bodies of Stop and Bus responses without request_id values, printed on first access.
+  // Null for unknown names.
+  const Json::PrintedValue* GetStopResponse(std::string_view name) const;
+  const Json::PrintedValue* GetBusResponse(std::string_view name) const;
+
+  LruCacheStats GetRouteCacheStats() const;
+  LruCacheStats GetTileCacheStats() const;
+
+  // Stops around the point, nearest first: at most max_count of them, not farther than max_distance meters
+  std::vector<SpatialIndex::Item> FindNearestStops(Sphere::Point point, size_t max_count, double max_distance) const;
 
+  std::string_view GetStopName(NameId stop_id) const;
+  std::string_view GetBusName(NameId bus_id) const;
+
+  // The map is rendered once, on the first call of either
+  const std::string& RenderMap() const;
+  // Rendered map printed as a JSON string, quotes included
+  const std::string& RenderMapJson() const;
+
+  struct MapTile {
+    std::string svg_json;  // the SVG printed as a JSON string, quotes included
+  };
+  using MapTilePtr = std::shared_ptr<const MapTile>;
+  // The shapes of the map that may be seen in the viewport, rendered with it as the view box.
+  // Repeated viewports are served from the tile cache.
+  MapTilePtr RenderMapTile(const Svg::ViewBox& viewport) const;
+  // Viewport of a map tile of the given zoom, nullopt for tiles out of the map
+  std::optional<Svg::ViewBox> GetMapTileViewport(int zoom, int x, int y) const;
+
+private:
   static double ComputeGeoRouteDistance(
-      const std::vector<std::string>& stops,
-      const Descriptions::StopsDict& stops_dict
+      const std::vector<NameId>& stop_ids,
+      const std::vector<Sphere::Point>& stop_positions
   );
 
-  static Svg::Document BuildMap(
+  static size_t ParseRouteCacheSize(const Json::Dict& routing_settings_json);
+  static size_t ParseTileCacheSize(const Json::Dict& render_settings_json);
+
+  Router MakeRouter(
       const Descriptions::StopsDict& stops_dict,
       const Descriptions::BusesDict& buses_dict,
-      const Json::Dict& render_settings_json
-  );
+      const std::vector<BusRoadRoute>& bus_routes,
+      const Json::Dict& routing_settings_json
+  ) const;
+
+  static Router LoadRouter(Snapshot::Reader& reader);
 
-  std::unordered_map<std::string, Stop> stops_;
-  std::unordered_map<std::string, Bus> buses_;
-  std::unique_ptr<TransportRouter> router_;
-  Svg::Document map_;
+  // Fields of buses are written apart, so that snapshots get no padding of Bus
+  void SerializeBuses(Snapshot::Writer& writer) const;
+  void LoadBuses(Snapshot::Reader& reader);
+
+  Stop MakeStop(NameId stop_id) const;
+
+  Json::PrintedValue PrintStopResponse(const Stop& stop) const;
+  static Json::PrintedValue PrintBusResponse(const Bus& bus);
+
+  // Mapped snapshot of a loaded catalog, first to outlive the members viewing it
+  std::unique_ptr<Snapshot::Reader> snapshot_;
+
+  // Names are kept only here, everything else refers to stops and buses by ids
+  NameInterner stop_names_;
+  NameInterner bus_names_;
+  // Buses of stop s are stop_bus_ids_[stop_bus_offsets_[s], stop_bus_offsets_[s + 1])
+  Snapshot::Array<size_t> stop_bus_offsets_;
+  Snapshot::Array<NameId> stop_bus_ids_;
+  SpatialIndex stops_index_;  // of stop positions, by stop ids
+  std::vector<Bus> buses_;  // by bus id
+  Router router_;
+
+  struct StopPairHasher {
+    size_t operator()(const std::pair<NameId, NameId>& stop_ids) const {
+      return (static_cast<uint64_t>(stop_ids.first) << 32) | stop_ids.second;
+    }
+  };
+  mutable LruCache<std::pair<NameId, NameId>, TransportRouter::RouteInfo, StopPairHasher> route_cache_;
+
+  struct CachedResponse {
+    std::once_flag once;
+    Json::PrintedValue response;
+  };
+  // By stop and bus ids
+  mutable std::vector<CachedResponse> stop_responses_;
+  mutable std::vector<CachedResponse> bus_responses_;
+
+  std::optional<MapRenderer> map_renderer_;  // set once constructed or loaded
+
+  // Parts of the map as built by MapRenderer::Render, released once rendered;
+  // catalogs loaded from snapshots get the rendered map right away
+  mutable std::vector<Svg::Document> map_parts_;
+  mutable std::once_flag map_once_;
+  mutable std::string map_;
+  mutable std::string map_json_;
+
+  void RenderMapOnce() const;
+
+  struct ViewBoxHasher {
+    size_t operator()(const Svg::ViewBox& view_box) const {
+      const std::hash<double> hasher;
+      return ((hasher(view_box.min.x) * 37 + hasher(view_box.min.y)) * 37 + hasher(view_box.width)) * 37
+          + hasher(view_box.height);
+    }
+  };
+  mutable LruCache<Svg::ViewBox, MapTile, ViewBoxHasher> tile_cache_;
 };
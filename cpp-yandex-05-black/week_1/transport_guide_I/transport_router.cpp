@@ -1,115 +1,302 @@
 #include "transport_router.h"
 
+#include <stdexcept>
+
 using namespace std;
 
 
 TransportRouter::TransportRouter(const Descriptions::StopsDict& stops_dict,
                                  const Descriptions::BusesDict& buses_dict,
-                                 const Json::Dict& routing_settings_json)
-    : routing_settings_(MakeRoutingSettings(routing_settings_json))
+                                 const Json::Dict& routing_settings_json,
+                                 const NameInterner& stop_names,
+                                 const NameInterner& bus_names,
+                                 const vector<BusRoadRoute>& bus_routes)
+    : routing_settings_(MakeRoutingSettings(routing_settings_json)),
+      stops_vertex_ids_(vector<StopVertexIds>(stop_names.size()))
 {
-  const size_t vertex_count = stops_dict.size() * 2;
-  vertices_info_.resize(vertex_count);
+  size_t vertex_count = stops_dict.size() * 2;
+  if (routing_settings_.graph_model == GraphModel::RIDE_CHAINS) {
+    for (const auto& [bus_name, _] : buses_dict) {
+      vertex_count += bus_routes[bus_names.GetId(bus_name)].stop_ids.size();
+    }
+  }
+  vertices_info_.Edit().resize(vertex_count);
   graph_ = BusGraph(vertex_count);
 
-  FillGraphWithStops(stops_dict);
-  FillGraphWithBuses(stops_dict, buses_dict);
+  FillGraphWithStops(stops_dict, stop_names);
+  if (routing_settings_.graph_model == GraphModel::RIDE_CHAINS) {
+    FillGraphWithRideChains(buses_dict, bus_names, bus_routes);
+  } else {
+    FillGraphWithBuses(buses_dict, bus_names, bus_routes);
+  }
+  graph_.Freeze();
 
-  router_ = std::make_unique<Router>(graph_);
+  router_ = MakeRouter();
+}
+
+TransportRouter::TransportRouter(Snapshot::Reader& reader)
+    : routing_settings_(LoadRoutingSettings(reader)),
+      graph_(reader),
+      router_(LoadRouter(reader)),
+      stops_vertex_ids_(reader.ReadMappedArray<StopVertexIds>()),
+      vertices_info_(reader.ReadMappedArray<VertexInfo>()),
+      edges_info_(reader.ReadMappedArray<EdgeInfo>())
+{
+  if (vertices_info_.size() != graph_.GetVertexCount() || edges_info_.size() != graph_.GetEdgeCount()) {
+    throw Snapshot::FormatError("malformed edges info");
+  }
+}
+
+void TransportRouter::Serialize(Snapshot::Writer& writer) const {
+  SerializeRoutingSettings(writer);
+  graph_.Serialize(writer);
+  visit([&writer](const auto& router) { router->Serialize(writer); }, router_);
+
+  writer.WriteArray(stops_vertex_ids_);
+  writer.WriteArray(vertices_info_);
+  writer.WriteArray(edges_info_);
 }
 
 TransportRouter::RoutingSettings TransportRouter::MakeRoutingSettings(const Json::Dict& json) {
+  const RouterEngine router_engine = ParseRouterEngine(json);
+  if (router_engine == RouterEngine::RAPTOR) {
+    throw invalid_argument("raptor is not an engine of the transport graph");
+  }
   return {
       json.at("bus_wait_time").AsInt(),
       json.at("bus_velocity").AsDouble(),
+      router_engine,
+      ParseGraphModel(json),
   };
 }
 
-void TransportRouter::FillGraphWithStops(const Descriptions::StopsDict& stops_dict) {
+TransportRouter::RoutingSettings TransportRouter::LoadRoutingSettings(Snapshot::Reader& reader) {
+  return {
+      reader.ReadValue<int>(),
+      reader.ReadValue<double>(),
+      reader.ReadValue<RouterEngine>(),
+      reader.ReadValue<GraphModel>(),
+  };
+}
+
+void TransportRouter::SerializeRoutingSettings(Snapshot::Writer& writer) const {
+  writer.WriteValue(routing_settings_.bus_wait_time);
+  writer.WriteValue(routing_settings_.bus_velocity);
+  writer.WriteValue(routing_settings_.router_engine);
+  writer.WriteValue(routing_settings_.graph_model);
+}
+
+TransportRouter::GraphModel TransportRouter::ParseGraphModel(const Json::Dict& json) {
+  if (json.count("graph_model") == 0) {
+    return GraphModel::STOP_PAIRS;
+  }
+  const string& name = json.at("graph_model").AsString();
+  if (name == "stop_pairs") {
+    return GraphModel::STOP_PAIRS;
+  } else if (name == "ride_chains") {
+    return GraphModel::RIDE_CHAINS;
+  } else {
+    throw invalid_argument("unknown graph model " + name);
+  }
+}
+
+TransportRouter::RouterEngine TransportRouter::ParseRouterEngine(const Json::Dict& json) {
+  if (json.count("router_engine") == 0) {
+    return RouterEngine::PRECOMPUTED;
+  }
+  const string& name = json.at("router_engine").AsString();
+  if (name == "precomputed") {
+    return RouterEngine::PRECOMPUTED;
+  } else if (name == "precomputed_compact") {
+    return RouterEngine::PRECOMPUTED_COMPACT;
+  } else if (name == "dijkstra") {
+    return RouterEngine::DIJKSTRA;
+  } else if (name == "contraction_hierarchies") {
+    return RouterEngine::CONTRACTION_HIERARCHIES;
+  } else if (name == "raptor") {
+    return RouterEngine::RAPTOR;
+  } else {
+    throw invalid_argument("unknown router engine " + name);
+  }
+}
+
+TransportRouter::Router TransportRouter::MakeRouter() const {
+  switch (routing_settings_.router_engine) {
+    case RouterEngine::PRECOMPUTED_COMPACT:
+      return make_unique<CompactPrecomputedRouter>(graph_);
+    case RouterEngine::DIJKSTRA:
+      return make_unique<DijkstraRouter>(graph_);
+    case RouterEngine::CONTRACTION_HIERARCHIES:
+      return make_unique<ContractionHierarchyRouter>(graph_);
+    case RouterEngine::PRECOMPUTED:
+    default:
+      return make_unique<PrecomputedRouter>(graph_);
+  }
+}
+
+TransportRouter::Router TransportRouter::LoadRouter(Snapshot::Reader& reader) const {
+  switch (routing_settings_.router_engine) {
+    case RouterEngine::PRECOMPUTED_COMPACT:
+      return make_unique<CompactPrecomputedRouter>(graph_, reader);
+    case RouterEngine::DIJKSTRA:
+      return make_unique<DijkstraRouter>(graph_, reader);
+    case RouterEngine::CONTRACTION_HIERARCHIES:
+      return make_unique<ContractionHierarchyRouter>(graph_, reader);
+    case RouterEngine::PRECOMPUTED:
+    default:
+      return make_unique<PrecomputedRouter>(graph_, reader);
+  }
+}
+
+void TransportRouter::FillGraphWithStops(const Descriptions::StopsDict& stops_dict, const NameInterner& stop_names) {
+  auto& vertices_info = vertices_info_.Edit();
+  auto& edges_info = edges_info_.Edit();
   Graph::VertexId vertex_id = 0;
 
   for (const auto& [stop_name, _] : stops_dict) {
-    auto& vertex_ids = stops_vertex_ids_[stop_name];
+    const NameId stop_id = stop_names.GetId(stop_name);
+    auto& vertex_ids = stops_vertex_ids_.Edit()[stop_id];
     vertex_ids.in = vertex_id++;
     vertex_ids.out = vertex_id++;
-    vertices_info_[vertex_ids.in] = {stop_name};
-    vertices_info_[vertex_ids.out] = {stop_name};
+    vertices_info[vertex_ids.in] = {stop_id};
+    vertices_info[vertex_ids.out] = {stop_id};
 
-    edges_info_.push_back(WaitEdgeInfo{});
+    edges_info.push_back({EdgeKind::WAIT, 0, 0});
     const Graph::EdgeId edge_id = graph_.AddEdge({
         vertex_ids.out,
         vertex_ids.in,
         static_cast<double>(routing_settings_.bus_wait_time)
     });
-    assert(edge_id == edges_info_.size() - 1);
+    assert(edge_id == edges_info.size() - 1);
   }
 
-  assert(vertex_id == graph_.GetVertexCount());
+  assert(vertex_id == stops_dict.size() * 2);
 }
 
-void TransportRouter::FillGraphWithBuses(const Descriptions::StopsDict& stops_dict,
-                                         const Descriptions::BusesDict& buses_dict) {
-  for (const auto& [_, bus_item] : buses_dict) {
-    const auto& bus = *bus_item;
-    const size_t stop_count = bus.stops.size();
+void TransportRouter::FillGraphWithBuses(const Descriptions::BusesDict& buses_dict,
+                                         const NameInterner& bus_names,
+                                         const vector<BusRoadRoute>& bus_routes) {
+  auto& edges_info = edges_info_.Edit();
+  for (const auto& [bus_name, _] : buses_dict) {
+    const NameId bus_id = bus_names.GetId(bus_name);
+    const BusRoadRoute& route = bus_routes[bus_id];
+    const size_t stop_count = route.stop_ids.size();
     if (stop_count <= 1) {
       continue;
     }
-    auto compute_distance_from = [&stops_dict, &bus](size_t lhs_idx) {
-      return Descriptions::ComputeStopsDistance(*stops_dict.at(bus.stops[lhs_idx]), *stops_dict.at(bus.stops[lhs_idx + 1]));
-    };
     for (size_t start_stop_idx = 0; start_stop_idx + 1 < stop_count; ++start_stop_idx) {
-      const Graph::VertexId start_vertex = stops_vertex_ids_[bus.stops[start_stop_idx]].in;
-      int total_distance = 0;
+      const Graph::VertexId start_vertex = stops_vertex_ids_[route.stop_ids[start_stop_idx]].in;
       for (size_t finish_stop_idx = start_stop_idx + 1; finish_stop_idx < stop_count; ++finish_stop_idx) {
-        total_distance += compute_distance_from(finish_stop_idx - 1);
-        edges_info_.push_back(BusEdgeInfo{
-            .bus_name = bus.name,
+        edges_info.push_back({
+            .kind = EdgeKind::BUS,
+            .bus_id = bus_id,
             .span_count = finish_stop_idx - start_stop_idx,
         });
         const Graph::EdgeId edge_id = graph_.AddEdge({
             start_vertex,
-            stops_vertex_ids_[bus.stops[finish_stop_idx]].out,
-            total_distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60)  // m / (km/h * 1000 / 60) = min
+            stops_vertex_ids_[route.stop_ids[finish_stop_idx]].out,
+            ComputeRideTime(route.GetDistance(start_stop_idx, finish_stop_idx))
         });
-        assert(edge_id == edges_info_.size() - 1);
+        assert(edge_id == edges_info.size() - 1);
+      }
+    }
+  }
+}
+
+void TransportRouter::FillGraphWithRideChains(const Descriptions::BusesDict& buses_dict,
+                                              const NameInterner& bus_names,
+                                              const vector<BusRoadRoute>& bus_routes) {
+  auto& vertices_info = vertices_info_.Edit();
+  auto& edges_info = edges_info_.Edit();
+  Graph::VertexId ride_vertex_id = stops_vertex_ids_.size() * 2;
+
+  for (const auto& [bus_name, _] : buses_dict) {
+    const NameId bus_id = bus_names.GetId(bus_name);
+    const BusRoadRoute& route = bus_routes[bus_id];
+    const size_t stop_count = route.stop_ids.size();
+    for (size_t stop_idx = 0; stop_idx < stop_count; ++stop_idx) {
+      const NameId stop_id = route.stop_ids[stop_idx];
+      const StopVertexIds& stop_vertex_ids = stops_vertex_ids_[stop_id];
+      const Graph::VertexId ride_vertex = ride_vertex_id++;
+      vertices_info[ride_vertex] = {stop_id};
+
+      // Boarding at the last stop leads nowhere, alighting at the first one is pointless
+      if (stop_idx + 1 < stop_count) {
+        edges_info.push_back({EdgeKind::BOARD, bus_id, 0});
+        graph_.AddEdge({stop_vertex_ids.in, ride_vertex, 0});
+      }
+      if (stop_idx > 0) {
+        edges_info.push_back({EdgeKind::RIDE, 0, 0});
+        graph_.AddEdge({ride_vertex - 1, ride_vertex, ComputeRideTime(route.GetDistance(stop_idx - 1, stop_idx))});
+        edges_info.push_back({EdgeKind::ALIGHT, 0, 0});
+        graph_.AddEdge({ride_vertex, stop_vertex_ids.out, 0});
       }
+      assert(graph_.GetEdgeCount() == edges_info.size());
     }
   }
+
+  assert(ride_vertex_id == graph_.GetVertexCount());
+}
+
+double TransportRouter::ComputeRideTime(int distance) const {
+  return distance * 1.0 / (routing_settings_.bus_velocity * 1000.0 / 60);  // m / (km/h * 1000 / 60) = min
 }
 
-optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(const string& stop_from, const string& stop_to) const {
-  const Graph::VertexId vertex_from = stops_vertex_ids_.at(stop_from).out;
-  const Graph::VertexId vertex_to = stops_vertex_ids_.at(stop_to).out;
-  const auto route = router_->BuildRoute(vertex_from, vertex_to);
-  if (!route) {
+template <typename RouterType>
+optional<TransportRouter::RouteInfo> TransportRouter::BuildRouteInfo(const RouterType& router,
+                                                                     Graph::VertexId vertex_from,
+                                                                     Graph::VertexId vertex_to) const {
+  thread_local vector<Graph::EdgeId> route_edges;
+  const auto total_time = router.BuildRoute(vertex_from, vertex_to, route_edges);
+  if (!total_time) {
     return nullopt;
   }
 
-  RouteInfo route_info = {.total_time = route->weight};
-  route_info.items.reserve(route->edge_count);
-  for (size_t edge_idx = 0; edge_idx < route->edge_count; ++edge_idx) {
-    const Graph::EdgeId edge_id = router_->GetRouteEdge(route->id, edge_idx);
+  RouteInfo route_info = {.total_time = *total_time};
+  route_info.items.reserve(route_edges.size());
+  for (const Graph::EdgeId edge_id : route_edges) {
     const auto& edge = graph_.GetEdge(edge_id);
-    const auto& edge_info = edges_info_[edge_id];
-    if (holds_alternative<BusEdgeInfo>(edge_info)) {
-      const BusEdgeInfo& bus_edge_info = get<BusEdgeInfo>(edge_info);
-      route_info.items.push_back(RouteInfo::BusItem{
-          .bus_name = bus_edge_info.bus_name,
-          .time = edge.weight,
-          .span_count = bus_edge_info.span_count,
-      });
-    } else {
-      const Graph::VertexId vertex_id = edge.from;
-      route_info.items.push_back(RouteInfo::WaitItem{
-          .stop_name = vertices_info_[vertex_id].stop_name,
-          .time = edge.weight,
-      });
+    const EdgeInfo& edge_info = edges_info_[edge_id];
+    switch (edge_info.kind) {
+      case EdgeKind::BUS:
+        route_info.items.push_back(RouteInfo::BusItem{
+            .bus_id = edge_info.bus_id,
+            .time = edge.weight,
+            .span_count = edge_info.span_count,
+        });
+        break;
+      case EdgeKind::WAIT:
+        route_info.items.push_back(RouteInfo::WaitItem{
+            .stop_id = vertices_info_[edge.from].stop_id,
+            .time = edge.weight,
+        });
+        break;
+      case EdgeKind::BOARD:
+        route_info.items.push_back(RouteInfo::BusItem{
+            .bus_id = edge_info.bus_id,
+            .time = 0,
+            .span_count = 0,
+        });
+        break;
+      case EdgeKind::RIDE: {
+        auto& bus_item = get<RouteInfo::BusItem>(route_info.items.back());
+        bus_item.time += edge.weight;
+        ++bus_item.span_count;
+        break;
+      }
+      case EdgeKind::ALIGHT:
+        break;
     }
   }
 
-  // Releasing in destructor of some proxy object would be better,
-  // but we do not expect exceptions in normal workflow
-  router_->ReleaseRoute(route->id);
   return route_info;
 }
+
+optional<TransportRouter::RouteInfo> TransportRouter::FindRoute(NameId stop_from, NameId stop_to) const {
+  const Graph::VertexId vertex_from = stops_vertex_ids_[stop_from].out;
+  const Graph::VertexId vertex_to = stops_vertex_ids_[stop_to].out;
+  return visit([this, vertex_from, vertex_to](const auto& router) {
+                 return BuildRouteInfo(*router, vertex_from, vertex_to);
+               },
+               router_);
+}
@@ -1,34 +1,70 @@
 #pragma once
 
+#include "ch_router.h"
 #include "descriptions.h"
+#include "dijkstra_router.h"
 #include "graph.h"
 #include "json.h"
+#include "name_interner.h"
+#include "road_distances.h"
 #include "router.h"
+#include "snapshot.h"
 
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
+#include <variant>
 #include <vector>
 
 class TransportRouter {
 private:
   using BusGraph = Graph::DirectedWeightedGraph<double>;
-  using Router = Graph::Router<double>;
+  using PrecomputedRouter = Graph::Router<double>;
+  using CompactPrecomputedRouter = Graph::Router<double, float>;
+  using DijkstraRouter = Graph::DijkstraRouter<double>;
+  using ContractionHierarchyRouter = Graph::ContractionHierarchyRouter<double>;
+  // TODO: Tell about this unique_ptr usage case
+  using Router = std::variant<
+      std::unique_ptr<PrecomputedRouter>,
+      std::unique_ptr<CompactPrecomputedRouter>,
+      std::unique_ptr<DijkstraRouter>,
+      std::unique_ptr<ContractionHierarchyRouter>
+  >;
 
 public:
+  enum class RouterEngine {
+    PRECOMPUTED,  // all-pairs table, O(V^2) memory, O(V^3) construction
+    PRECOMPUTED_COMPACT,  // same table with float weights, 8 bytes per vertex pair
+    DIJKSTRA,     // nothing precomputed, one search per query
+    CONTRACTION_HIERARCHIES,  // shortcuts precomputed, bidirectional upward search per query
+    RAPTOR,       // no graph at all: served by RaptorRouter, never by TransportRouter
+  };
+
+  // Engine named by the "router_engine" routing setting, PRECOMPUTED if there is none.
+  // Throws invalid_argument for an unknown name.
+  static RouterEngine ParseRouterEngine(const Json::Dict& json);
+
+  // Stops and buses are identified by ids of stop_names and bus_names, bus_routes are by bus id
   TransportRouter(const Descriptions::StopsDict& stops_dict,
                   const Descriptions::BusesDict& buses_dict,
-                  const Json::Dict& routing_settings_json);
+                  const Json::Dict& routing_settings_json,
+                  const NameInterner& stop_names,
+                  const NameInterner& bus_names,
+                  const std::vector<BusRoadRoute>& bus_routes);
+  // Router written by Serialize, viewed in the mapping of the reader
+  explicit TransportRouter(Snapshot::Reader& reader);
+
+  void Serialize(Snapshot::Writer& writer) const;
 
   struct RouteInfo {
     double total_time;
 
     struct BusItem {
-      std::string bus_name;
+      NameId bus_id;
       double time;
       size_t span_count;
     };
     struct WaitItem {
-      std::string stop_name;
+      NameId stop_id;
       double time;
     };
 
@@ -36,41 +72,73 @@ public:
     std::vector<Item> items;
   };
 
-  std::optional<RouteInfo> FindRoute(const std::string& stop_from, const std::string& stop_to) const;
+  std::optional<RouteInfo> FindRoute(NameId stop_from, NameId stop_to) const;
 
 private:
+  enum class GraphModel {
+    STOP_PAIRS,   // an edge for every pair of stops of a bus, O(n^2) edges per bus
+    RIDE_CHAINS,  // a vertex for every stop of a bus chained by ride edges, O(n) edges per bus
+  };
+
   struct RoutingSettings {
     int bus_wait_time;  // in minutes
     double bus_velocity;  // km/h
+    RouterEngine router_engine;
+    GraphModel graph_model;
   };
 
   static RoutingSettings MakeRoutingSettings(const Json::Dict& json);
+  // Written field by field, so that no padding gets into snapshots
+  static RoutingSettings LoadRoutingSettings(Snapshot::Reader& reader);
+  void SerializeRoutingSettings(Snapshot::Writer& writer) const;
+  static GraphModel ParseGraphModel(const Json::Dict& json);
 
-  void FillGraphWithStops(const Descriptions::StopsDict& stops_dict);
+  Router MakeRouter() const;
+  Router LoadRouter(Snapshot::Reader& reader) const;
 
-  void FillGraphWithBuses(const Descriptions::StopsDict& stops_dict,
-                          const Descriptions::BusesDict& buses_dict);
+  void FillGraphWithStops(const Descriptions::StopsDict& stops_dict, const NameInterner& stop_names);
+
+  void FillGraphWithBuses(const Descriptions::BusesDict& buses_dict,
+                          const NameInterner& bus_names,
+                          const std::vector<BusRoadRoute>& bus_routes);
+
+  void FillGraphWithRideChains(const Descriptions::BusesDict& buses_dict,
+                               const NameInterner& bus_names,
+                               const std::vector<BusRoadRoute>& bus_routes);
+
+  double ComputeRideTime(int distance) const;
 
   struct StopVertexIds {
     Graph::VertexId in;
     Graph::VertexId out;
   };
   struct VertexInfo {
-    std::string stop_name;
+    NameId stop_id;
   };
 
-  struct BusEdgeInfo {
-    std::string bus_name;
-    size_t span_count;
+  // A BUS edge rides span_count spans of a bus at once. In the ride chains model
+  // a BOARD edge starts a BusItem and every RIDE edge adds one span to it.
+  enum class EdgeKind : uint32_t {
+    BUS,
+    WAIT,
+    BOARD,
+    RIDE,
+    ALIGHT,
   };
-  struct WaitEdgeInfo {};
-  using EdgeInfo = std::variant<BusEdgeInfo, WaitEdgeInfo>;
+  // Plain fields without padding, so that loaded routers view them in the snapshot
+  struct EdgeInfo {
+    EdgeKind kind;
+    NameId bus_id;  // of BUS and BOARD edges
+    size_t span_count;  // of BUS edges
+  };
+
+  template <typename RouterType>
+  std::optional<RouteInfo> BuildRouteInfo(const RouterType& router, Graph::VertexId from, Graph::VertexId to) const;
 
   RoutingSettings routing_settings_;
   BusGraph graph_;
-  // TODO: Tell about this unique_ptr usage case
-  std::unique_ptr<Router> router_;
-  std::unordered_map<std::string, StopVertexIds> stops_vertex_ids_;
-  std::vector<VertexInfo> vertices_info_;
-  std::vector<EdgeInfo> edges_info_;
+  Router router_;
+  Snapshot::Array<StopVertexIds> stops_vertex_ids_;  // by stop id
+  Snapshot::Array<VertexInfo> vertices_info_;
+  Snapshot::Array<EdgeInfo> edges_info_;
 };
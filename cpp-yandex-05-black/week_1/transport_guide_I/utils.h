@@ -1,9 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <future>
 #include <iterator>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 template <typename It>
 class Range {
@@ -13,6 +17,7 @@ public:
   Range(It begin, It end) : begin_(begin), end_(end) {}
   It begin() const { return begin_; }
   It end() const { return end_; }
+  size_t size() const { return std::distance(begin_, end_); }
 
 private:
   It begin_;
@@ -31,8 +36,9 @@ size_t ComputeUniqueItemsCount(Range<It> range) {
   }.size();
 }
 
-template <typename K, typename V>
-const V* GetValuePointer(const std::unordered_map<K, V>& map, const K& key) {
+// Key may be of any type the map can look up by, e.g. a string_view for a map with std::less<>
+template <typename Map, typename Key>
+const typename Map::mapped_type* GetValuePointer(const Map& map, const Key& key) {
   if (auto it = map.find(key); it != end(map)) {
     return &it->second;
   } else {
@@ -40,6 +46,30 @@ const V* GetValuePointer(const std::unordered_map<K, V>& map, const K& key) {
   }
 }
 
+// Calls func(idx) for every idx in [0, count),
+// splitting indices into contiguous chunks processed by separate threads
+template <typename Func>
+void ParallelFor(size_t count, const Func& func, size_t thread_count = std::thread::hardware_concurrency()) {
+  thread_count = std::max<size_t>(1, std::min(thread_count, count));
+  const size_t chunk_size = (count + thread_count - 1) / thread_count;
+
+  std::vector<std::future<void>> futures;
+  for (size_t chunk_begin = chunk_size; chunk_begin < count; chunk_begin += chunk_size) {
+    const size_t chunk_end = std::min(count, chunk_begin + chunk_size);
+    futures.push_back(std::async(std::launch::async, [&func, chunk_begin, chunk_end] {
+      for (size_t idx = chunk_begin; idx < chunk_end; ++idx) {
+        func(idx);
+      }
+    }));
+  }
+  for (size_t idx = 0; idx < std::min(chunk_size, count); ++idx) {
+    func(idx);
+  }
+  for (auto& future : futures) {
+    future.get();
+  }
+}
+
 std::string_view Strip(std::string_view line);
 
 bool IsZero(double x);